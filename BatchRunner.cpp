@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <chrono>
+
+#include "BatchRunner.h"
+
+// A thread count of zero or less uses every hardware thread.
+BatchRunner::BatchRunner(const int num_threads, const int score_bucket_size) : pool(num_threads), score_bucket_size(std::max(1, score_bucket_size))
+{
+    for (int x = 0; x < pool.get_num_threads(); x++)
+    {
+        workers.emplace_back(new Worker);
+    }
+}
+
+int BatchRunner::get_num_threads()
+{
+    return pool.get_num_threads();
+}
+
+// Plays num_games games with seeds first_seed, first_seed + 1, ..., each until
+// the player gives up, the game is over or max_pieces pieces have been played.
+// start_game, if given, is called on each game first.
+BatchRunner::Results BatchRunner::run_players(const uint64_t first_seed, const int num_games, const PieceRandomizer::Policy policy, const Player &player, const int max_pieces, const GameStarter &start_game)
+{
+    const auto start_time = std::chrono::steady_clock::now();
+    start_batch();
+    pool.run(num_games, [&](int game_index, int worker_index)
+             {
+        Worker &worker = *workers[worker_index];
+        worker.game = TetrisGame(first_seed + game_index, policy);
+        if (start_game)
+        {
+            start_game(worker.game, worker_index);
+        }
+        for (int x = 0; x < max_pieces && !worker.game.get_whether_the_game_is_over(); x++)
+        {
+            if (!player(worker.game, worker_index))
+            {
+                break;
+            }
+        }
+        add_game(worker); });
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    return finish_batch(elapsed.count());
+}
+
+BatchRunner::Results BatchRunner::run_replays(const std::vector<Replay> &replays)
+{
+    const auto start_time = std::chrono::steady_clock::now();
+    start_batch();
+    pool.run(replays.size(), [&](int replay_index, int worker_index)
+             {
+        Worker &worker = *workers[worker_index];
+        const Replay &replay = replays[replay_index];
+        worker.game = TetrisGame(replay.get_seed(), replay.get_policy());
+        replay.play(worker.game);
+        add_game(worker); });
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    return finish_batch(elapsed.count());
+}
+
+void BatchRunner::start_batch()
+{
+    for (auto &worker : workers)
+    {
+        worker->results = Results();
+        worker->results.score_bucket_size = score_bucket_size;
+    }
+}
+
+void BatchRunner::add_game(Worker &worker)
+{
+    Results &results = worker.results;
+    const int score = worker.game.get_score();
+    const auto line_clear_counts = worker.game.get_line_clear_counts();
+
+    results.min_score = results.num_games == 0 ? score : std::min(results.min_score, score);
+    results.max_score = std::max(results.max_score, score);
+    results.num_games++;
+    results.total_score += score;
+    for (int x = 0; x < int(line_clear_counts.size()); x++)
+    {
+        results.line_clear_counts[x] += line_clear_counts[x];
+        results.num_pieces += line_clear_counts[x];
+    }
+
+    const int bucket = score / score_bucket_size;
+    if (bucket >= int(results.score_histogram.size()))
+    {
+        results.score_histogram.resize(bucket + 1);
+    }
+    results.score_histogram[bucket]++;
+}
+
+BatchRunner::Results BatchRunner::finish_batch(const double seconds)
+{
+    Results total;
+    total.score_bucket_size = score_bucket_size;
+    total.seconds = seconds;
+    for (auto &worker : workers)
+    {
+        const Results &results = worker->results;
+        if (results.num_games == 0)
+        {
+            continue;
+        }
+        total.min_score = total.num_games == 0 ? results.min_score : std::min(total.min_score, results.min_score);
+        total.max_score = std::max(total.max_score, results.max_score);
+        total.num_games += results.num_games;
+        total.num_pieces += results.num_pieces;
+        total.total_score += results.total_score;
+        for (int x = 0; x < int(total.line_clear_counts.size()); x++)
+        {
+            total.line_clear_counts[x] += results.line_clear_counts[x];
+        }
+        if (results.score_histogram.size() > total.score_histogram.size())
+        {
+            total.score_histogram.resize(results.score_histogram.size());
+        }
+        for (int x = 0; x < int(results.score_histogram.size()); x++)
+        {
+            total.score_histogram[x] += results.score_histogram[x];
+        }
+    }
+    return total;
+}
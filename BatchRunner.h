@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "TetrisGame.h"
+#include "ThreadPool.h"
+
+// Runs many independent games headless, sharded across a thread pool, and
+// gathers statistics over all of them. Each worker thread keeps one game that
+// is reset in place for every game it runs, and its own statistics that are
+// only merged at the end of a batch, so workers never wait on each other.
+class BatchRunner
+{
+public:
+    // Plays one piece of the game and returns false if it can't. The second
+    // argument is the worker index, below get_num_threads(), for choosing
+    // per-thread scratch.
+    using Player = std::function<bool(TetrisGame &, int)>;
+    // Called with each new game before its first piece is played, and the
+    // worker index as for Player.
+    using GameStarter = std::function<void(TetrisGame &, int)>;
+
+    struct Results
+    {
+        uint64_t num_games = 0;
+        uint64_t num_pieces = 0;
+        uint64_t total_score = 0;
+        int min_score = 0;
+        int max_score = 0;
+        std::array<uint64_t, 5> line_clear_counts = {};
+        // Games by score, score_bucket_size scores per bucket.
+        std::vector<uint64_t> score_histogram;
+        int score_bucket_size = 1;
+        double seconds = 0;
+    };
+
+    BatchRunner(const int, const int);
+    int get_num_threads();
+    Results run_players(const uint64_t, const int, const PieceRandomizer::Policy, const Player &, const int, const GameStarter & = nullptr);
+    Results run_replays(const std::vector<Replay> &);
+
+private:
+    struct Worker
+    {
+        TetrisGame game;
+        Results results;
+    };
+
+    ThreadPool pool;
+    std::vector<std::unique_ptr<Worker>> workers;
+    int score_bucket_size;
+
+    void start_batch();
+    void add_game(Worker &);
+    Results finish_batch(const double);
+};
@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <cstdlib>
+#include <queue>
+
+#include "BeamSearchBot.h"
+
+using Input = Replay::Input;
+
+// A thread count of zero or less uses every hardware thread.
+BeamSearchBot::BeamSearchBot(const int num_threads) : pool(num_threads), transposition_table(transposition_table_log2_size)
+{
+    for (int x = 0; x < pool.get_num_threads(); x++)
+    {
+        workers.emplace_back(new Worker);
+    }
+}
+
+int BeamSearchBot::get_last_search_depth()
+{
+    return last_search_depth;
+}
+
+uint64_t BeamSearchBot::get_last_search_nodes()
+{
+    return last_search_nodes;
+}
+
+// Searches from the game's current state and plays the chosen move on it.
+// Returns false without touching the game if the game is over or the falling
+// piece has nowhere to go.
+bool BeamSearchBot::play_move(TetrisGame &game, const int beam_width, const std::chrono::milliseconds time_budget)
+{
+    if (game.get_whether_the_game_is_over())
+    {
+        return false;
+    }
+
+    const auto start_time = std::chrono::steady_clock::now();
+
+    // Mixed into every hash so results from earlier moves never match.
+    search_key += 0x9E3779B97F4A7C15ULL;
+
+    search_origin = game.snapshot();
+    beam.clear();
+    beam.push_back({game.search_snapshot(), 0, 0, false, game.get_falling_piece()});
+    last_search_depth = 0;
+    last_search_nodes = 0;
+
+    for (int depth = 0; depth < max_search_depth; depth++)
+    {
+        pool.run(beam.size(), [&](int node_index, int worker)
+                 { expand(node_index, *workers[worker]); });
+        select_next_beam(depth, beam_width);
+        if (next_beam.empty())
+        {
+            break;
+        }
+        beam.swap(next_beam);
+        last_search_depth = depth + 1;
+
+        if (std::chrono::steady_clock::now() - start_time >= time_budget)
+        {
+            break;
+        }
+    }
+
+    if (last_search_depth == 0)
+    {
+        return false;
+    }
+    return play_first_move(game, beam[0]);
+}
+
+// Adds a candidate for every placement of the node's falling piece, and of the
+// piece it would get by holding, to the worker's list. A piece that would come
+// from past the end of the preview is not placed.
+void BeamSearchBot::expand(const int node_index, Worker &worker)
+{
+    const Node &node = beam[node_index];
+    TetrisGame &game = worker.game;
+    for (int holds = 0; holds < 2; holds++)
+    {
+        game.restore(node.state, search_origin);
+        int num_pieces_drawn = node.num_pieces_drawn;
+        if (holds)
+        {
+            num_pieces_drawn += !game.get_whether_a_piece_is_held();
+            game.hold_piece();
+        }
+        if (num_pieces_drawn > TetrisGame::num_upcoming_pieces_shown)
+        {
+            continue;
+        }
+        const GameState start = game.snapshot();
+
+        const int num_placements = worker.generator.generate(game);
+        for (int x = 0; x < num_placements; x++)
+        {
+            const FallingPiece &placement = worker.generator.get_placement(x);
+            game.restore(start);
+            game.lock_falling_piece_at(placement);
+            if (game.get_whether_the_game_is_over())
+            {
+                continue;
+            }
+
+            Candidate candidate;
+            candidate.reward = node.reward + line_clear_weight * game.get_last_line_clear().num_lines_cleared;
+            candidate.value = candidate.reward + evaluate(game.get_board_features());
+            candidate.parent = node_index;
+            candidate.placement_index = x;
+            candidate.holds = holds;
+            candidate.placement = placement;
+            candidate.hash = game.get_hash();
+            worker.candidates.push_back(candidate);
+        }
+    }
+}
+
+// Merges the workers' candidates best first, skipping states already reached
+// by another move order at this depth, until the new beam is full.
+void BeamSearchBot::select_next_beam(const int depth, const int beam_width)
+{
+    const int num_workers = workers.size();
+    pool.run(num_workers, [&](int worker_index, int)
+             {
+        auto &candidates = workers[worker_index]->candidates;
+        std::sort(candidates.begin(), candidates.end(), candidate_is_better); });
+
+    using MergePosition = std::pair<const Candidate *, const Candidate *>;
+    auto is_worse_position = [](const MergePosition &a, const MergePosition &b)
+    {
+        return candidate_is_better(*b.first, *a.first);
+    };
+    std::priority_queue<MergePosition, std::vector<MergePosition>, decltype(is_worse_position)> merge(is_worse_position);
+    for (auto &worker : workers)
+    {
+        last_search_nodes += worker->candidates.size();
+        if (!worker->candidates.empty())
+        {
+            merge.push({worker->candidates.data(), worker->candidates.data() + worker->candidates.size()});
+        }
+    }
+
+    selected.clear();
+    while (!merge.empty() && int(selected.size()) < beam_width)
+    {
+        auto [candidate, end] = merge.top();
+        merge.pop();
+        if (candidate + 1 != end)
+        {
+            merge.push({candidate + 1, end});
+        }
+
+        const uint64_t key = candidate->hash ^ search_key;
+        TranspositionTable::Result result;
+        if (transposition_table.probe(key, result) && result.depth == depth)
+        {
+            continue;
+        }
+        transposition_table.store(key, {candidate->value, uint16_t(depth), candidate->placement_index});
+        selected.push_back(candidate);
+    }
+
+    next_beam.resize(selected.size());
+    pool.run(selected.size(), [&](int x, int worker)
+             { make_node(*selected[x], depth, *workers[worker], next_beam[x]); });
+
+    for (auto &worker : workers)
+    {
+        worker->candidates.clear();
+    }
+}
+
+void BeamSearchBot::make_node(const Candidate &candidate, const int depth, Worker &worker, Node &node)
+{
+    const Node &parent = beam[candidate.parent];
+    TetrisGame &game = worker.game;
+    game.restore(parent.state, search_origin);
+    node.num_pieces_drawn = parent.num_pieces_drawn + 1;
+    if (candidate.holds)
+    {
+        node.num_pieces_drawn += !game.get_whether_a_piece_is_held();
+        game.hold_piece();
+    }
+    game.lock_falling_piece_at(candidate.placement);
+
+    node.state = game.search_snapshot();
+    node.reward = candidate.reward;
+    if (depth == 0)
+    {
+        node.first_move_holds = candidate.holds;
+        node.first_placement = candidate.placement;
+    }
+    else
+    {
+        node.first_move_holds = parent.first_move_holds;
+        node.first_placement = parent.first_placement;
+    }
+}
+
+// Higher is better. Line clears are rewarded separately, line_clear_weight
+// per line.
+int BeamSearchBot::evaluate(const TetrisGame::BoardFeatures &features)
+{
+    return aggregate_height_weight * features.aggregate_height +
+           holes_weight * features.holes +
+           bumpiness_weight * features.bumpiness +
+           wells_weight * features.wells +
+           row_transitions_weight * features.row_transitions +
+           column_transitions_weight * features.column_transitions;
+}
+
+// Orders by value, then by where the candidate came from, so the search picks
+// the same moves however the work was split between threads.
+bool BeamSearchBot::candidate_is_better(const Candidate &a, const Candidate &b)
+{
+    if (a.value != b.value)
+    {
+        return a.value > b.value;
+    }
+    if (a.parent != b.parent)
+    {
+        return a.parent < b.parent;
+    }
+    if (a.holds != b.holds)
+    {
+        return b.holds;
+    }
+    return a.placement_index < b.placement_index;
+}
+
+bool BeamSearchBot::is_same_placement(const FallingPiece &a, const FallingPiece &b)
+{
+    if (a.type != b.type || a.rotation_state != b.rotation_state)
+    {
+        return false;
+    }
+    for (int x = 0; x < int(a.positions.size()); x++)
+    {
+        if (a.positions[x].i != b.positions[x].i || a.positions[x].j != b.positions[x].j)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BeamSearchBot::play_first_move(TetrisGame &game, const Node &best)
+{
+    if (best.first_move_holds)
+    {
+        game.hold_piece();
+    }
+
+    PlacementGenerator &generator = workers[0]->generator;
+    const int num_placements = generator.generate(game);
+    for (int x = 0; x < num_placements; x++)
+    {
+        if (is_same_placement(generator.get_placement(x), best.first_placement))
+        {
+            std::vector<Input> path(generator.get_path_length(x));
+            generator.get_path(x, path.data());
+            for (auto input : path)
+            {
+                game.apply_input(input);
+            }
+            game.hard_drop();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "TetrisGame.h"
+#include "PlacementGenerator.h"
+#include "ThreadPool.h"
+#include "TranspositionTable.h"
+
+// Plays a TetrisGame by beam search over the falling piece and the preview.
+// Each level of the search expands every node in the beam into all of its
+// placements, with and without holding first, scores the children by their
+// line clears and board features and keeps the best beam_width distinct
+// states for the next level. Expansion is spread over a work-stealing thread
+// pool. The move played is the first move of the best node at the deepest
+// level finished within the time budget, entered through the same inputs a
+// player would use.
+class BeamSearchBot
+{
+public:
+    BeamSearchBot(const int);
+    bool play_move(TetrisGame &, const int, const std::chrono::milliseconds);
+    int get_last_search_depth();
+    uint64_t get_last_search_nodes();
+    static int evaluate(const TetrisGame::BoardFeatures &);
+
+    static const int line_clear_weight = 760;
+
+private:
+    using FallingPiece = TetrisGame::FallingPiece;
+    using GameState = TetrisGame::GameState;
+    using SearchState = TetrisGame::SearchState;
+    using BoardFeatures = TetrisGame::BoardFeatures;
+
+    // The falling piece and the preview are all the search can see. Holding
+    // into an empty hold slot draws a piece early, so a line of play that
+    // does so runs out of visible pieces a level sooner.
+    static const int max_search_depth = TetrisGame::num_upcoming_pieces_shown + 1;
+    static const int transposition_table_log2_size = 20;
+
+    static const int aggregate_height_weight = -510;
+    static const int holes_weight = -360;
+    static const int bumpiness_weight = -180;
+    static const int wells_weight = -60;
+    static const int row_transitions_weight = -30;
+    static const int column_transitions_weight = -90;
+
+    struct Node
+    {
+        SearchState state;
+        int reward;
+        // Pieces taken from the preview since the search started.
+        int num_pieces_drawn;
+        bool first_move_holds;
+        FallingPiece first_placement;
+    };
+
+    struct Candidate
+    {
+        int value;
+        int reward;
+        int parent;
+        uint16_t placement_index;
+        bool holds;
+        FallingPiece placement;
+        uint64_t hash;
+    };
+
+    struct Worker
+    {
+        TetrisGame game;
+        PlacementGenerator generator;
+        std::vector<Candidate> candidates;
+    };
+
+    ThreadPool pool;
+    TranspositionTable transposition_table;
+    std::vector<std::unique_ptr<Worker>> workers;
+    // The game as the search started, which every node's state is restored
+    // against.
+    GameState search_origin;
+    std::vector<Node> beam;
+    std::vector<Node> next_beam;
+    std::vector<const Candidate *> selected;
+    uint64_t search_key = 0;
+    int last_search_depth = 0;
+    uint64_t last_search_nodes = 0;
+
+    static bool candidate_is_better(const Candidate &, const Candidate &);
+    static bool is_same_placement(const FallingPiece &, const FallingPiece &);
+    void expand(const int, Worker &);
+    void select_next_beam(const int, const int);
+    void make_node(const Candidate &, const int, Worker &, Node &);
+    bool play_first_move(TetrisGame &, const Node &);
+};
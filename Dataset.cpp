@@ -0,0 +1,577 @@
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+
+#include "Dataset.h"
+
+// File layout, all little endian:
+//   header:      magic, version, record size, records per chunk
+//   chunks:      compressed records, records_per_chunk to a chunk except the
+//                last, each followed by a checksum of its compressed bytes
+//   chunk table: file offset of each chunk, then the end of the last chunk
+//   game table:  first record, seed, record count and policy of each game
+//   footer:      chunk and game table offsets, record and game counts, magic
+//
+// A chunk is compressed by turning each record into its xor with what the
+// record before it predicts, then storing byte x of every record together so
+// the zeros left form long runs, and then run-length coding the zeros.
+// Control bytes below 128 are followed by that many plus one literal bytes,
+// and the rest stand for (control - 127) zero bytes.
+
+namespace
+{
+    const uint32_t file_magic = 0x54534454; // "TDST"
+    const uint8_t file_version = 1;
+    const int record_size = 64;
+    const int records_per_chunk = 1024;
+    const int header_size = 8;
+    const int game_entry_size = 24;
+    const int footer_size = 40;
+    const int max_run_length = 128;
+    const int checksum_size = 4;
+
+    template <typename T>
+    void write_little_endian(std::ofstream &file, const T value)
+    {
+        for (size_t x = 0; x < sizeof(T); x++)
+        {
+            file.put(static_cast<char>((value >> (8 * x)) & 0xFF));
+        }
+    }
+
+    template <typename T>
+    void store_little_endian(uint8_t *bytes, const T value)
+    {
+        for (size_t x = 0; x < sizeof(T); x++)
+        {
+            bytes[x] = static_cast<uint8_t>((value >> (8 * x)) & 0xFF);
+        }
+    }
+
+    template <typename T>
+    T load_little_endian(const uint8_t *bytes)
+    {
+        T value = 0;
+        for (size_t x = 0; x < sizeof(T); x++)
+        {
+            value |= static_cast<T>(bytes[x]) << (8 * x);
+        }
+        return value;
+    }
+
+    // 32-bit FNV-1a.
+    uint32_t compute_checksum(const uint8_t *bytes, const uint64_t num_bytes)
+    {
+        uint32_t checksum = 2166136261u;
+        for (uint64_t x = 0; x < num_bytes; x++)
+        {
+            checksum = (checksum ^ bytes[x]) * 16777619u;
+        }
+        return checksum;
+    }
+
+    void encode_record(const DatasetRecord &record, uint8_t *bytes)
+    {
+        std::fill(bytes, bytes + record_size, 0);
+        for (int i = 0; i < TetrisGame::board_height; i++)
+        {
+            store_little_endian(bytes + 2 * i, record.board_rows[i]);
+        }
+        store_little_endian(bytes + 44, record.score);
+        std::copy(record.placement, record.placement + 4, bytes + 48);
+        bytes[52] = record.falling_piece;
+        bytes[53] = record.held_piece;
+        std::copy(record.upcoming_pieces, record.upcoming_pieces + TetrisGame::num_upcoming_pieces_shown, bytes + 54);
+        bytes[59] = record.lines_cleared;
+        bytes[60] = record.used_hold;
+    }
+
+    void decode_record(const uint8_t *bytes, DatasetRecord &record)
+    {
+        for (int i = 0; i < TetrisGame::board_height; i++)
+        {
+            record.board_rows[i] = load_little_endian<uint16_t>(bytes + 2 * i);
+        }
+        record.score = load_little_endian<uint32_t>(bytes + 44);
+        std::copy(bytes + 48, bytes + 52, record.placement);
+        record.falling_piece = bytes[52];
+        record.held_piece = bytes[53];
+        std::copy(bytes + 54, bytes + 54 + TetrisGame::num_upcoming_pieces_shown, record.upcoming_pieces);
+        record.lines_cleared = bytes[59];
+        record.used_hold = bytes[60];
+    }
+
+    // What a record is expected to be given the record before it in the same
+    // game: the previous board with the previous piece locked into it, the
+    // preview moved up by one, and the same held piece and score.
+    DatasetRecord predict_record(const DatasetRecord &previous)
+    {
+        DatasetRecord record = previous;
+        TetrisGame::OccupancyBoard board;
+        std::copy(previous.board_rows, previous.board_rows + TetrisGame::board_height, board.begin());
+        TetrisGame::PiecePositions positions;
+        for (int x = 0; x < 4; x++)
+        {
+            positions[x] = {int8_t(previous.placement[x] / TetrisGame::board_width), int8_t(previous.placement[x] % TetrisGame::board_width)};
+        }
+        TetrisGame::lock_piece(board, positions);
+        std::copy(board.begin(), board.end(), record.board_rows);
+
+        record.falling_piece = previous.upcoming_pieces[0];
+        std::copy(previous.upcoming_pieces + 1, previous.upcoming_pieces + TetrisGame::num_upcoming_pieces_shown, record.upcoming_pieces);
+        return record;
+    }
+
+    // Compresses the records into output. Each record is stored as its xor
+    // with its prediction from the record before, so a typical move leaves
+    // only the new preview piece and the placement.
+    void compress_chunk(const std::vector<DatasetRecord> &records, std::vector<uint8_t> &residuals, std::vector<uint8_t> &output)
+    {
+        const int num_records = records.size();
+        residuals.resize(num_records * record_size);
+        uint8_t predicted_bytes[record_size];
+        for (int record = 0; record < num_records; record++)
+        {
+            uint8_t *residual = residuals.data() + record * record_size;
+            encode_record(records[record], residual);
+            if (record > 0)
+            {
+                encode_record(predict_record(records[record - 1]), predicted_bytes);
+                for (int byte = 0; byte < record_size; byte++)
+                {
+                    residual[byte] ^= predicted_bytes[byte];
+                }
+            }
+        }
+
+        auto get_byte = [&](int position)
+        {
+            return residuals[(position % num_records) * record_size + position / num_records];
+        };
+
+        const int total_bytes = num_records * record_size;
+        int position = 0;
+        while (position < total_bytes)
+        {
+            int zeros = 0;
+            while (position + zeros < total_bytes && zeros < max_run_length && get_byte(position + zeros) == 0)
+            {
+                zeros++;
+            }
+            // A lone zero between literals is cheaper kept as a literal.
+            if (zeros >= 2 || (zeros == 1 && position + 1 == total_bytes))
+            {
+                output.push_back(uint8_t(127 + zeros));
+                position += zeros;
+                continue;
+            }
+
+            const size_t control = output.size();
+            output.push_back(0);
+            int literals = 0;
+            while (position < total_bytes && literals < max_run_length)
+            {
+                if (get_byte(position) == 0 && position + 1 < total_bytes && get_byte(position + 1) == 0)
+                {
+                    break;
+                }
+                output.push_back(get_byte(position));
+                position++;
+                literals++;
+            }
+            output[control] = uint8_t(literals - 1);
+        }
+    }
+
+    bool decompress_chunk(const uint8_t *input, const uint64_t input_size, const int num_records, std::vector<uint8_t> &residuals, std::vector<DatasetRecord> &records)
+    {
+        const int total_bytes = num_records * record_size;
+        residuals.resize(total_bytes);
+        int position = 0;
+        uint64_t x = 0;
+        while (position < total_bytes)
+        {
+            if (x >= input_size)
+            {
+                return false;
+            }
+            const uint8_t control = input[x++];
+            const int run_length = control < 128 ? control + 1 : control - 127;
+            if (position + run_length > total_bytes || (control < 128 && x + run_length > input_size))
+            {
+                return false;
+            }
+            for (int y = 0; y < run_length; y++, position++)
+            {
+                residuals[(position % num_records) * record_size + position / num_records] = control < 128 ? input[x++] : 0;
+            }
+        }
+        if (x != input_size)
+        {
+            return false;
+        }
+
+        records.resize(num_records);
+        uint8_t predicted_bytes[record_size];
+        for (int record = 0; record < num_records; record++)
+        {
+            uint8_t *residual = residuals.data() + record * record_size;
+            if (record > 0)
+            {
+                encode_record(predict_record(records[record - 1]), predicted_bytes);
+                for (int byte = 0; byte < record_size; byte++)
+                {
+                    residual[byte] ^= predicted_bytes[byte];
+                }
+            }
+            decode_record(residual, records[record]);
+            // Corrupt bytes could otherwise index outside the board when
+            // predicting the next record.
+            for (auto square : records[record].placement)
+            {
+                if (square >= TetrisGame::board_height * TetrisGame::board_width)
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Maps the whole file read-only. Returns nullptr if it can't be opened or
+    // is empty.
+    const uint8_t *map_file(const std::string &filename, uint64_t &size)
+    {
+#if defined(_WIN32)
+        const HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return nullptr;
+        }
+        LARGE_INTEGER file_size;
+        const void *view = nullptr;
+        if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+        {
+            // The view keeps the mapping open after both handles are closed.
+            const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping)
+            {
+                view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+        size = view ? file_size.QuadPart : 0;
+        return static_cast<const uint8_t *>(view);
+#else
+        const int descriptor = ::open(filename.c_str(), O_RDONLY);
+        if (descriptor < 0)
+        {
+            return nullptr;
+        }
+        struct stat file_status;
+        void *mapping = MAP_FAILED;
+        if (fstat(descriptor, &file_status) == 0 && file_status.st_size > 0)
+        {
+            mapping = mmap(nullptr, file_status.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+        }
+        ::close(descriptor);
+        if (mapping == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        size = file_status.st_size;
+        return static_cast<const uint8_t *>(mapping);
+#endif
+    }
+
+    void unmap_file(const uint8_t *data, const uint64_t size)
+    {
+#if defined(_WIN32)
+        (void)size;
+        UnmapViewOfFile(data);
+#else
+        munmap(const_cast<uint8_t *>(data), size);
+#endif
+    }
+}
+
+DatasetWriter::DatasetWriter()
+{
+    chunk_records.reserve(records_per_chunk);
+}
+
+DatasetWriter::~DatasetWriter()
+{
+    close();
+}
+
+bool DatasetWriter::open(const std::string &filename)
+{
+    close();
+    file.open(filename, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        return false;
+    }
+
+    num_records = 0;
+    chunk_records.clear();
+    chunk_offsets.clear();
+    games.clear();
+    write_little_endian(file, file_magic);
+    write_little_endian(file, file_version);
+    write_little_endian(file, static_cast<uint8_t>(record_size));
+    write_little_endian(file, static_cast<uint16_t>(records_per_chunk));
+    file_offset = header_size;
+    return static_cast<bool>(file);
+}
+
+// Writes the records not yet written and the index. Returns false if any
+// write since open failed.
+bool DatasetWriter::close()
+{
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    if (!chunk_records.empty())
+    {
+        write_chunk();
+    }
+
+    const uint64_t chunk_table_offset = file_offset;
+    for (auto offset : chunk_offsets)
+    {
+        write_little_endian(file, offset);
+    }
+    write_little_endian(file, file_offset);
+
+    const uint64_t game_table_offset = chunk_table_offset + 8 * (chunk_offsets.size() + 1);
+    for (auto &game : games)
+    {
+        write_little_endian(file, game.first_record);
+        write_little_endian(file, game.seed);
+        write_little_endian(file, game.num_records);
+        write_little_endian(file, static_cast<uint32_t>(game.policy));
+    }
+
+    write_little_endian(file, chunk_table_offset);
+    write_little_endian(file, game_table_offset);
+    write_little_endian(file, num_records);
+    write_little_endian(file, static_cast<uint64_t>(games.size()));
+    write_little_endian(file, file_magic);
+    write_little_endian(file, static_cast<uint32_t>(0));
+
+    const bool succeeded = static_cast<bool>(file);
+    file.close();
+    return succeeded;
+}
+
+uint64_t DatasetWriter::get_num_records()
+{
+    return num_records;
+}
+
+uint64_t DatasetWriter::get_num_games()
+{
+    return games.size();
+}
+
+// Starts a new game from the game's current state and makes the writer its
+// lock observer, so every later lock adds a record to it.
+void DatasetWriter::begin_game(TetrisGame &game)
+{
+    games.push_back({num_records, game.get_seed(), 0, static_cast<uint8_t>(game.get_policy())});
+    piece_spawned(game);
+    game.set_lock_observer(this);
+}
+
+void DatasetWriter::piece_spawned(TetrisGame &game)
+{
+    const auto locked_rows = game.get_locked_rows();
+    std::copy(locked_rows.begin(), locked_rows.end(), pending_record.board_rows);
+    pending_record.falling_piece = static_cast<uint8_t>(game.get_falling_piece().type);
+    pending_record.held_piece = game.get_whether_a_piece_is_held() ? static_cast<uint8_t>(game.get_held_piece()) : DatasetRecord::no_piece;
+    for (int x = 0; x < TetrisGame::num_upcoming_pieces_shown; x++)
+    {
+        pending_record.upcoming_pieces[x] = static_cast<uint8_t>(game.get_upcoming_piece(x));
+    }
+}
+
+void DatasetWriter::piece_locked(const TetrisGame::PiecePositions &positions, const int lines_cleared, const bool used_hold, const int score)
+{
+    if (games.empty())
+    {
+        return;
+    }
+
+    for (int x = 0; x < 4; x++)
+    {
+        pending_record.placement[x] = uint8_t(positions[x].i * TetrisGame::board_width + positions[x].j);
+    }
+    pending_record.lines_cleared = uint8_t(lines_cleared);
+    pending_record.used_hold = used_hold;
+    pending_record.score = uint32_t(score);
+
+    chunk_records.push_back(pending_record);
+    num_records++;
+    games.back().num_records++;
+    if (int(chunk_records.size()) == records_per_chunk)
+    {
+        write_chunk();
+    }
+}
+
+void DatasetWriter::write_chunk()
+{
+    compressed_bytes.clear();
+    compress_chunk(chunk_records, chunk_bytes, compressed_bytes);
+    const uint32_t checksum = compute_checksum(compressed_bytes.data(), compressed_bytes.size());
+    compressed_bytes.resize(compressed_bytes.size() + checksum_size);
+    store_little_endian(compressed_bytes.data() + compressed_bytes.size() - checksum_size, checksum);
+    chunk_offsets.push_back(file_offset);
+    file.write(reinterpret_cast<const char *>(compressed_bytes.data()), compressed_bytes.size());
+    file_offset += compressed_bytes.size();
+    chunk_records.clear();
+}
+
+DatasetReader::DatasetReader()
+{
+}
+
+DatasetReader::~DatasetReader()
+{
+    close();
+}
+
+// Maps the file and checks its header and index. Returns false and leaves the
+// reader closed if the file can't be mapped or isn't a dataset.
+bool DatasetReader::open(const std::string &filename)
+{
+    close();
+    data = map_file(filename, size);
+    if (!data)
+    {
+        return false;
+    }
+    if (size < header_size + footer_size)
+    {
+        close();
+        return false;
+    }
+
+    const uint8_t *footer = data + size - footer_size;
+    const uint64_t chunk_table_offset = load_little_endian<uint64_t>(footer);
+    const uint64_t game_table_offset = load_little_endian<uint64_t>(footer + 8);
+    num_records = load_little_endian<uint64_t>(footer + 16);
+    num_games = load_little_endian<uint64_t>(footer + 24);
+    const uint64_t num_chunks = (num_records + records_per_chunk - 1) / records_per_chunk;
+    if (load_little_endian<uint32_t>(data) != file_magic ||
+        data[4] != file_version ||
+        data[5] != record_size ||
+        load_little_endian<uint16_t>(data + 6) != records_per_chunk ||
+        load_little_endian<uint32_t>(footer + 32) != file_magic ||
+        chunk_table_offset < header_size ||
+        game_table_offset != chunk_table_offset + 8 * (num_chunks + 1) ||
+        num_games > size / game_entry_size ||
+        game_table_offset + num_games * game_entry_size != size - footer_size)
+    {
+        close();
+        return false;
+    }
+    chunk_table = data + chunk_table_offset;
+    game_table = data + game_table_offset;
+    return true;
+}
+
+void DatasetReader::close()
+{
+    if (data)
+    {
+        unmap_file(data, size);
+    }
+    data = nullptr;
+    size = 0;
+    num_records = 0;
+    num_games = 0;
+    cached_chunk = -1;
+}
+
+uint64_t DatasetReader::get_num_records()
+{
+    return num_records;
+}
+
+uint64_t DatasetReader::get_num_games()
+{
+    return num_games;
+}
+
+uint64_t DatasetReader::get_file_size()
+{
+    return size;
+}
+
+DatasetReader::Game DatasetReader::get_game(const uint64_t game_index)
+{
+    const uint8_t *entry = game_table + game_index * game_entry_size;
+    Game game;
+    game.first_record = load_little_endian<uint64_t>(entry);
+    game.seed = load_little_endian<uint64_t>(entry + 8);
+    game.num_records = load_little_endian<uint32_t>(entry + 16);
+    game.policy = static_cast<PieceRandomizer::Policy>(load_little_endian<uint32_t>(entry + 20));
+    return game;
+}
+
+// Returns false if the record doesn't exist or its chunk fails its checksum.
+bool DatasetReader::read_record(const uint64_t record_index, DatasetRecord &record)
+{
+    if (record_index >= num_records || !load_chunk(record_index / records_per_chunk))
+    {
+        return false;
+    }
+    record = cached_records[record_index % records_per_chunk];
+    return true;
+}
+
+bool DatasetReader::read_game_record(const uint64_t game_index, const uint32_t move, DatasetRecord &record)
+{
+    if (game_index >= num_games)
+    {
+        return false;
+    }
+    const Game game = get_game(game_index);
+    return move < game.num_records && read_record(game.first_record + move, record);
+}
+
+bool DatasetReader::load_chunk(const uint64_t chunk)
+{
+    if (int64_t(chunk) == cached_chunk)
+    {
+        return true;
+    }
+
+    const uint64_t begin = load_little_endian<uint64_t>(chunk_table + 8 * chunk);
+    const uint64_t end = load_little_endian<uint64_t>(chunk_table + 8 * (chunk + 1));
+    const int num_chunk_records = std::min<uint64_t>(records_per_chunk, num_records - chunk * records_per_chunk);
+    const uint64_t chunk_table_offset = chunk_table - data;
+    if (begin < header_size || begin + checksum_size > end || end > chunk_table_offset ||
+        load_little_endian<uint32_t>(data + end - checksum_size) != compute_checksum(data + begin, end - begin - checksum_size) ||
+        !decompress_chunk(data + begin, end - begin - checksum_size, num_chunk_records, chunk_bytes, cached_records))
+    {
+        cached_chunk = -1;
+        return false;
+    }
+    cached_chunk = chunk;
+    return true;
+}
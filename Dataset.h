@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "TetrisGame.h"
+
+// One move of a recorded game: the state when the piece spawned, where it was
+// locked and what that did. Rows are bit masks with bit j set when column j
+// is occupied, bottom row first, and pieces are TetrisGame::PieceType values.
+struct DatasetRecord
+{
+    static const uint8_t no_piece = TetrisGame::num_piece_types;
+
+    uint16_t board_rows[TetrisGame::board_height];
+    // Score after the move.
+    uint32_t score;
+    // i * board_width + j of each square of the locked piece.
+    uint8_t placement[4];
+    uint8_t falling_piece;
+    uint8_t held_piece;
+    uint8_t upcoming_pieces[TetrisGame::num_upcoming_pieces_shown];
+    uint8_t lines_cleared;
+    uint8_t used_hold;
+};
+
+// Streams a DatasetRecord for every piece locked by the games recorded to it
+// into a file of fixed-size chunks of records, each compressed on its own,
+// with an index of chunks and games at the end for random access. A writer is
+// not thread safe, so parallel self-play should give each worker its own file.
+class DatasetWriter : public TetrisGame::LockObserver
+{
+public:
+    DatasetWriter();
+    ~DatasetWriter();
+    DatasetWriter(const DatasetWriter &) = delete;
+    DatasetWriter &operator=(const DatasetWriter &) = delete;
+    bool open(const std::string &);
+    bool close();
+    uint64_t get_num_records();
+    uint64_t get_num_games();
+
+    void begin_game(TetrisGame &);
+    void piece_spawned(TetrisGame &) override;
+    void piece_locked(const TetrisGame::PiecePositions &, const int, const bool, const int) override;
+
+private:
+    struct Game
+    {
+        uint64_t first_record;
+        uint64_t seed;
+        uint32_t num_records;
+        uint8_t policy;
+    };
+
+    std::ofstream file;
+    uint64_t file_offset = 0;
+    uint64_t num_records = 0;
+    DatasetRecord pending_record = {};
+    std::vector<DatasetRecord> chunk_records;
+    std::vector<uint8_t> chunk_bytes;
+    std::vector<uint8_t> compressed_bytes;
+    std::vector<uint64_t> chunk_offsets;
+    std::vector<Game> games;
+
+    void write_chunk();
+};
+
+// Reads a file made by DatasetWriter through a read-only memory mapping. Only
+// the chunk holding a requested record is decompressed, and the last one
+// decompressed is kept, so reading a game's moves in order decompresses each
+// chunk once.
+class DatasetReader
+{
+public:
+    struct Game
+    {
+        uint64_t seed;
+        PieceRandomizer::Policy policy;
+        uint64_t first_record;
+        uint32_t num_records;
+    };
+
+    DatasetReader();
+    ~DatasetReader();
+    DatasetReader(const DatasetReader &) = delete;
+    DatasetReader &operator=(const DatasetReader &) = delete;
+    bool open(const std::string &);
+    void close();
+    uint64_t get_num_records();
+    uint64_t get_num_games();
+    uint64_t get_file_size();
+    Game get_game(const uint64_t);
+    bool read_record(const uint64_t, DatasetRecord &);
+    bool read_game_record(const uint64_t, const uint32_t, DatasetRecord &);
+
+private:
+    const uint8_t *data = nullptr;
+    uint64_t size = 0;
+    const uint8_t *chunk_table = nullptr;
+    const uint8_t *game_table = nullptr;
+    uint64_t num_records = 0;
+    uint64_t num_games = 0;
+    int64_t cached_chunk = -1;
+    std::vector<DatasetRecord> cached_records;
+    std::vector<uint8_t> chunk_bytes;
+
+    bool load_chunk(const uint64_t);
+};
@@ -0,0 +1,268 @@
+#include <algorithm>
+
+#include "GameSimulation.h"
+
+GameSimulation::GameSimulation(const TetrisGame &new_game) : game(new_game), tick_time(Clock::now())
+{
+    for (auto &snapshot : snapshots)
+    {
+        write_snapshot(snapshot);
+    }
+    thread = std::thread(&GameSimulation::run, this);
+}
+
+GameSimulation::~GameSimulation()
+{
+    stopping.store(true, std::memory_order_relaxed);
+    thread.join();
+}
+
+// Key events may only be sent from one thread. Returns false if the queue is
+// full and the event was dropped.
+bool GameSimulation::press(const Key key)
+{
+    return push_key_event(key, true);
+}
+
+bool GameSimulation::release(const Key key)
+{
+    return push_key_event(key, false);
+}
+
+// May only be called from one thread. The snapshot stays unchanged until the
+// next call.
+const GameSimulation::Snapshot &GameSimulation::get_latest_snapshot()
+{
+    if (middle_snapshot.load(std::memory_order_relaxed) & fresh_snapshot_flag)
+    {
+        front_snapshot = middle_snapshot.exchange(front_snapshot, std::memory_order_acq_rel) & snapshot_index_mask;
+    }
+    return snapshots[front_snapshot];
+}
+
+// How many rows below its snapshot position to draw the falling piece at a
+// given time, interpolating between the snapshot's tick and the next one.
+float GameSimulation::get_fall_offset(const Snapshot &snapshot, const Clock::time_point time)
+{
+    const float ticks_since_snapshot = std::chrono::duration<float, Ticks::period>(time - snapshot.time).count();
+    const float progress = snapshot.fall_progress + snapshot.fall_progress_per_tick * std::min(std::max(ticks_since_snapshot, 0.0f), 1.0f);
+    return std::min(progress, 1.0f);
+}
+
+bool GameSimulation::push_key_event(const Key key, const bool pressed)
+{
+    return key_events.push({key, pressed, Clock::now()});
+}
+
+// Ticks are scheduled from a start time rather than from the last tick, so
+// late wake-ups don't add up to drift, and a late wake-up runs every tick that
+// has come due since. When more than max_catch_up_ticks are due the start time
+// moves forward past the rest.
+void GameSimulation::run()
+{
+    auto start_time = tick_time;
+    while (!stopping.load(std::memory_order_relaxed))
+    {
+        const auto next_tick_time = start_time + std::chrono::duration_cast<Clock::duration>(Ticks(tick + 1));
+        std::this_thread::sleep_until(next_tick_time);
+
+        const auto now = Clock::now();
+        const uint64_t due_tick = std::chrono::duration_cast<Ticks>(now - start_time).count();
+        if (due_tick > tick + max_catch_up_ticks)
+        {
+            start_time += std::chrono::duration_cast<Clock::duration>(Ticks(due_tick - tick - max_catch_up_ticks));
+        }
+
+        while (true)
+        {
+            const auto time = start_time + std::chrono::duration_cast<Clock::duration>(Ticks(tick + 1));
+            if (time > now)
+            {
+                break;
+            }
+            tick_time = time;
+            apply_key_events_until(tick_time);
+            advance_tick();
+        }
+        publish_snapshot();
+    }
+}
+
+// Events that happened after the tick are left for the next one. Once the
+// game is over they are dropped, like every later tick.
+void GameSimulation::apply_key_events_until(const Clock::time_point tick_time)
+{
+    while (a_key_event_is_pending || key_events.pop(pending_key_event))
+    {
+        a_key_event_is_pending = pending_key_event.time > tick_time;
+        if (a_key_event_is_pending)
+        {
+            return;
+        }
+        if (!game.get_whether_the_game_is_over())
+        {
+            apply_key_event(pending_key_event);
+        }
+    }
+}
+
+void GameSimulation::apply_key_event(const KeyEvent &event)
+{
+    switch (event.key)
+    {
+    case Key::LEFT:
+        left_is_held = event.pressed;
+        if (event.pressed)
+        {
+            game.handle_left_input();
+            auto_repeat_counter = 0;
+        }
+        break;
+    case Key::RIGHT:
+        right_is_held = event.pressed;
+        if (event.pressed)
+        {
+            game.handle_right_input();
+            auto_repeat_counter = 0;
+        }
+        break;
+    case Key::SOFT_DROP:
+        soft_drop_is_held = event.pressed;
+        if (event.pressed)
+        {
+            game.soft_drop();
+            soft_drop_counter = 0;
+            gravity_counter = 0;
+        }
+        break;
+    case Key::ROTATE_LEFT:
+        if (event.pressed)
+        {
+            game.rotate_left();
+        }
+        break;
+    case Key::ROTATE_RIGHT:
+        if (event.pressed)
+        {
+            game.rotate_right();
+        }
+        break;
+    case Key::HARD_DROP:
+        if (event.pressed)
+        {
+            game.hard_drop();
+        }
+        break;
+    case Key::HOLD:
+        if (event.pressed)
+        {
+            game.hold_piece();
+        }
+        break;
+    }
+}
+
+// A soft drop restarts the gravity count, and holding left and right together
+// moves neither way. The last spawn of a finished game can overlap locked
+// squares, and moving it would erase them, so nothing is applied to the game
+// after it is over.
+void GameSimulation::advance_tick()
+{
+    tick++;
+    if (game.get_whether_the_game_is_over())
+    {
+        return;
+    }
+    gravity_counter++;
+
+    if (soft_drop_is_held && ++soft_drop_counter == ticks_per_soft_drop)
+    {
+        soft_drop_counter = 0;
+        gravity_counter = 0;
+        game.soft_drop();
+        if (game.get_whether_the_game_is_over())
+        {
+            return;
+        }
+    }
+
+    if (left_is_held != right_is_held && ++auto_repeat_counter == ticks_per_auto_repeat)
+    {
+        auto_repeat_counter = 0;
+        if (left_is_held)
+        {
+            game.handle_left_input();
+        }
+        else
+        {
+            game.handle_right_input();
+        }
+    }
+
+    if (gravity_counter == ticks_per_gravity)
+    {
+        gravity_counter = 0;
+        game.iterate_time();
+    }
+}
+
+void GameSimulation::write_snapshot(Snapshot &snapshot)
+{
+    for (int i = 0; i < TetrisGame::board_height; i++)
+    {
+        for (int j = 0; j < TetrisGame::board_width; j++)
+        {
+            snapshot.board[i][j] = game.get_square(i, j);
+        }
+    }
+
+    const TetrisGame::PiecePositions positions = game.get_falling_piece().positions;
+    snapshot.a_piece_is_falling = !game.get_whether_the_game_is_over();
+    snapshot.falling_piece_positions = positions;
+    snapshot.falling_piece_color = snapshot.board[positions[0].i][positions[0].j];
+    snapshot.fall_progress = 0.0f;
+    snapshot.fall_progress_per_tick = 0.0f;
+    if (snapshot.a_piece_is_falling)
+    {
+        for (const auto &position : positions)
+        {
+            snapshot.board[position.i][position.j] = Snapshot::BSC::EMPTY;
+        }
+        // Soft drop restarts the gravity count every time it moves the
+        // piece, so while it is held it always drops the piece first.
+        const bool piece_can_fall = game.get_ghost_positions()[0].i != positions[0].i;
+        if (piece_can_fall && soft_drop_is_held)
+        {
+            snapshot.fall_progress = float(soft_drop_counter) / ticks_per_soft_drop;
+            snapshot.fall_progress_per_tick = 1.0f / ticks_per_soft_drop;
+        }
+        else if (piece_can_fall)
+        {
+            snapshot.fall_progress = float(gravity_counter) / ticks_per_gravity;
+            snapshot.fall_progress_per_tick = 1.0f / ticks_per_gravity;
+        }
+    }
+
+    for (int i = 0; i < TetrisGame::num_upcoming_pieces_shown; i++)
+    {
+        for (int j = 0; j < TetrisGame::upcoming_board_lines_per_piece; j++)
+        {
+            for (int k = 0; k < TetrisGame::upcoming_board_width; k++)
+            {
+                snapshot.upcoming_pieces[i][j][k] = game.get_upcoming_square(i, j, k);
+            }
+        }
+    }
+    snapshot.score = game.get_score();
+    snapshot.held_piece = game.get_held_piece();
+    snapshot.a_piece_is_held = game.get_whether_a_piece_is_held();
+    snapshot.game_is_over = game.get_whether_the_game_is_over();
+    snapshot.tick = tick;
+    snapshot.time = tick_time;
+}
+
+void GameSimulation::publish_snapshot()
+{
+    write_snapshot(snapshots[back_snapshot]);
+    back_snapshot = middle_snapshot.exchange(back_snapshot | fresh_snapshot_flag, std::memory_order_acq_rel) & snapshot_index_mask;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include "SpscQueue.h"
+#include "TetrisGame.h"
+
+// Runs a TetrisGame on its own thread at a fixed tick rate, so gravity, soft
+// drop and auto-repeat keep time however long the renderer takes to draw a
+// frame. Key presses and releases reach the game through a lock-free queue,
+// stamped with when they happened, and each tick applies the ones that
+// happened before it. Whenever the thread wakes up it runs every tick that is
+// due and then publishes the game as an immutable Snapshot that the renderer
+// draws from without locking or waiting.
+class GameSimulation
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Ticks = std::chrono::duration<int64_t, std::ratio<1, 120>>;
+
+    // 500 ms gravity, 100 ms soft drop and 167 ms auto-repeat.
+    static const int ticks_per_gravity = 60;
+    static const int ticks_per_soft_drop = 12;
+    static const int ticks_per_auto_repeat = 20;
+    // After a longer stall (a suspended process, a debugger) the rest of the
+    // missed time is skipped rather than fast-forwarded through.
+    static const int max_catch_up_ticks = 30;
+
+    enum class Key : uint8_t
+    {
+        LEFT,
+        RIGHT,
+        ROTATE_LEFT,
+        ROTATE_RIGHT,
+        SOFT_DROP,
+        HARD_DROP,
+        HOLD
+    };
+
+    // Everything the renderer draws. The falling piece is kept off the board
+    // while the game is running, so it can be drawn part of the way to the
+    // row below; see get_fall_offset().
+    struct Snapshot
+    {
+        using BSC = TetrisGame::BoardSquareColor;
+        using UpcomingPiece = std::array<std::array<BSC, TetrisGame::upcoming_board_width>, TetrisGame::upcoming_board_lines_per_piece>;
+
+        std::array<std::array<BSC, TetrisGame::board_width>, TetrisGame::board_height> board;
+        std::array<UpcomingPiece, TetrisGame::num_upcoming_pieces_shown> upcoming_pieces;
+        TetrisGame::PiecePositions falling_piece_positions;
+        BSC falling_piece_color;
+        bool a_piece_is_falling;
+        // How far the falling piece is toward dropping a row as of this tick,
+        // and how much further it gets each tick. Both are zero while the
+        // piece rests on the stack.
+        float fall_progress;
+        float fall_progress_per_tick;
+        int score;
+        TetrisGame::PieceType held_piece;
+        bool a_piece_is_held;
+        bool game_is_over;
+        uint64_t tick;
+        Clock::time_point time;
+    };
+
+    GameSimulation(const TetrisGame &);
+    ~GameSimulation();
+    bool press(const Key);
+    bool release(const Key);
+    const Snapshot &get_latest_snapshot();
+    static float get_fall_offset(const Snapshot &, const Clock::time_point);
+
+private:
+    struct KeyEvent
+    {
+        Key key;
+        bool pressed;
+        Clock::time_point time;
+    };
+
+    static const int key_queue_capacity = 256;
+
+    // The simulation thread fills the back snapshot and swaps it with the
+    // middle one; the renderer swaps its front snapshot with the middle one
+    // when the fresh flag says a newer one is there. With the spare middle
+    // slot neither side ever waits for the other, and a snapshot is never
+    // written while the renderer holds it.
+    static const uint8_t snapshot_index_mask = 3;
+    static const uint8_t fresh_snapshot_flag = 4;
+
+    TetrisGame game;
+    SpscQueue<KeyEvent, key_queue_capacity> key_events;
+
+    // Only touched by the simulation thread.
+    KeyEvent pending_key_event;
+    bool a_key_event_is_pending = false;
+    bool soft_drop_is_held = false;
+    bool left_is_held = false;
+    bool right_is_held = false;
+    int gravity_counter = 0;
+    int soft_drop_counter = 0;
+    int auto_repeat_counter = 0;
+    uint64_t tick = 0;
+    Clock::time_point tick_time;
+
+    std::array<Snapshot, 3> snapshots;
+    int back_snapshot = 0;
+    int front_snapshot = 1;
+    std::atomic<uint8_t> middle_snapshot{2};
+
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+
+    void run();
+    bool push_key_event(const Key, const bool);
+    void apply_key_events_until(const Clock::time_point);
+    void apply_key_event(const KeyEvent &);
+    void advance_tick();
+    void write_snapshot(Snapshot &);
+    void publish_snapshot();
+};
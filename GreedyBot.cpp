@@ -0,0 +1,48 @@
+#include "GreedyBot.h"
+#include "BeamSearchBot.h"
+
+using Input = Replay::Input;
+
+GreedyBot::GreedyBot(const int num_threads)
+{
+    for (int x = 0; x < num_threads; x++)
+    {
+        generators.emplace_back(new PlacementGenerator);
+    }
+}
+
+// Plays the falling piece using the given thread's scratch. Returns false if
+// the piece has nowhere to go.
+bool GreedyBot::play_move(TetrisGame &game, const int thread)
+{
+    auto &generator = *generators[thread];
+    const int num_placements = generator.generate(game);
+    if (num_placements == 0)
+    {
+        return false;
+    }
+
+    const int num_locked_squares = game.get_board_features().num_locked_squares;
+    int best_placement = 0;
+    int best_value = 0;
+    for (int x = 0; x < num_placements; x++)
+    {
+        const auto features = game.evaluate_placement(generator.get_placement(x).positions);
+        const int lines_cleared = (num_locked_squares + 4 - features.num_locked_squares) / TetrisGame::board_width;
+        const int value = BeamSearchBot::line_clear_weight * lines_cleared + BeamSearchBot::evaluate(features);
+        if (x == 0 || value > best_value)
+        {
+            best_placement = x;
+            best_value = value;
+        }
+    }
+
+    std::vector<Input> path(generator.get_path_length(best_placement));
+    generator.get_path(best_placement, path.data());
+    for (auto input : path)
+    {
+        game.apply_input(input);
+    }
+    game.hard_drop();
+    return true;
+}
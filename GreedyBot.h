@@ -0,0 +1,20 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "TetrisGame.h"
+#include "PlacementGenerator.h"
+
+// Places each piece where it leaves the best board by the beam search bot's
+// evaluation, without looking ahead or holding. It keeps a placement generator
+// per thread, so one bot can play many games at once.
+class GreedyBot
+{
+public:
+    GreedyBot(const int);
+    bool play_move(TetrisGame &, const int);
+
+private:
+    std::vector<std::unique_ptr<PlacementGenerator>> generators;
+};
@@ -0,0 +1,456 @@
+#if defined(__AVX512BW__) || defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "LockstepBoards.h"
+
+namespace
+{
+    using BoardRow = LockstepBoards::BoardRow;
+    using LaneMask = LockstepBoards::LaneMask;
+    const int num_lanes = LockstepBoards::num_lanes;
+
+    // The same row of every lane, with the handful of operations the boards
+    // need: bitwise logic, shifting every lane by one square, and per-lane
+    // tests and selects driven by a LaneMask.
+#if defined(__AVX512BW__)
+    using RowVector = __m512i;
+
+    RowVector load(const BoardRow *row) { return _mm512_load_si512(row); }
+    void store(BoardRow *row, const RowVector v) { _mm512_store_si512(row, v); }
+    RowVector zero() { return _mm512_setzero_si512(); }
+    RowVector broadcast(const BoardRow value) { return _mm512_set1_epi16(value); }
+    RowVector bitwise_or(const RowVector a, const RowVector b) { return _mm512_or_si512(a, b); }
+    RowVector bitwise_and(const RowVector a, const RowVector b) { return _mm512_and_si512(a, b); }
+    RowVector shift_up(const RowVector v) { return _mm512_slli_epi16(v, 1); }
+    RowVector shift_down(const RowVector v) { return _mm512_srli_epi16(v, 1); }
+    LaneMask nonzero_lanes(const RowVector v) { return _mm512_test_epi16_mask(v, v); }
+    LaneMask equal_lanes(const RowVector a, const RowVector b) { return _mm512_cmpeq_epi16_mask(a, b); }
+    RowVector select(const LaneMask mask, const RowVector if_clear, const RowVector if_set) { return _mm512_mask_blend_epi16(mask, if_clear, if_set); }
+#elif defined(__AVX2__)
+    struct RowVector
+    {
+        __m256i low;
+        __m256i high;
+    };
+
+    // Packs the 16-bit compare results of both halves into a bit per lane.
+    LaneMask lanes_of(const __m256i low, const __m256i high)
+    {
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(low, high), 0xD8);
+        return _mm256_movemask_epi8(packed);
+    }
+
+    __m256i expand_mask(const uint32_t half_mask)
+    {
+        const __m256i lane_bits = _mm256_setr_epi16(1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 4, 1 << 5, 1 << 6, 1 << 7,
+                                                    1 << 8, 1 << 9, 1 << 10, 1 << 11, 1 << 12, 1 << 13, 1 << 14, short(1 << 15));
+        const __m256i selected = _mm256_and_si256(_mm256_set1_epi16(short(half_mask)), lane_bits);
+        return _mm256_cmpeq_epi16(selected, lane_bits);
+    }
+
+    RowVector load(const BoardRow *row) { return {_mm256_load_si256((const __m256i *)row), _mm256_load_si256((const __m256i *)(row + 16))}; }
+    void store(BoardRow *row, const RowVector v)
+    {
+        _mm256_store_si256((__m256i *)row, v.low);
+        _mm256_store_si256((__m256i *)(row + 16), v.high);
+    }
+    RowVector zero() { return {_mm256_setzero_si256(), _mm256_setzero_si256()}; }
+    RowVector broadcast(const BoardRow value) { return {_mm256_set1_epi16(value), _mm256_set1_epi16(value)}; }
+    RowVector bitwise_or(const RowVector a, const RowVector b) { return {_mm256_or_si256(a.low, b.low), _mm256_or_si256(a.high, b.high)}; }
+    RowVector bitwise_and(const RowVector a, const RowVector b) { return {_mm256_and_si256(a.low, b.low), _mm256_and_si256(a.high, b.high)}; }
+    RowVector shift_up(const RowVector v) { return {_mm256_slli_epi16(v.low, 1), _mm256_slli_epi16(v.high, 1)}; }
+    RowVector shift_down(const RowVector v) { return {_mm256_srli_epi16(v.low, 1), _mm256_srli_epi16(v.high, 1)}; }
+    LaneMask equal_lanes(const RowVector a, const RowVector b) { return lanes_of(_mm256_cmpeq_epi16(a.low, b.low), _mm256_cmpeq_epi16(a.high, b.high)); }
+    LaneMask nonzero_lanes(const RowVector v) { return ~equal_lanes(v, zero()); }
+    RowVector select(const LaneMask mask, const RowVector if_clear, const RowVector if_set)
+    {
+        return {_mm256_blendv_epi8(if_clear.low, if_set.low, expand_mask(mask & 0xFFFF)),
+                _mm256_blendv_epi8(if_clear.high, if_set.high, expand_mask(mask >> 16))};
+    }
+#elif defined(__SSE2__)
+    // Every x86-64 compiler targets SSE2, so this is the default there.
+    const int lanes_per_part = 8;
+    const int num_parts = num_lanes / lanes_per_part;
+
+    struct RowVector
+    {
+        __m128i parts[num_parts];
+    };
+
+    __m128i expand_mask(const uint32_t part_mask)
+    {
+        const __m128i lane_bits = _mm_setr_epi16(1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 4, 1 << 5, 1 << 6, 1 << 7);
+        return _mm_cmpeq_epi16(_mm_and_si128(_mm_set1_epi16(short(part_mask)), lane_bits), lane_bits);
+    }
+
+    RowVector load(const BoardRow *row)
+    {
+        RowVector v;
+        for (int p = 0; p < num_parts; p++)
+        {
+            v.parts[p] = _mm_load_si128((const __m128i *)(row + p * lanes_per_part));
+        }
+        return v;
+    }
+
+    void store(BoardRow *row, const RowVector &v)
+    {
+        for (int p = 0; p < num_parts; p++)
+        {
+            _mm_store_si128((__m128i *)(row + p * lanes_per_part), v.parts[p]);
+        }
+    }
+
+    RowVector broadcast(const BoardRow value)
+    {
+        RowVector v;
+        for (int p = 0; p < num_parts; p++)
+        {
+            v.parts[p] = _mm_set1_epi16(value);
+        }
+        return v;
+    }
+
+    RowVector zero() { return broadcast(0); }
+
+    RowVector bitwise_or(const RowVector &a, const RowVector &b)
+    {
+        RowVector v;
+        for (int p = 0; p < num_parts; p++)
+        {
+            v.parts[p] = _mm_or_si128(a.parts[p], b.parts[p]);
+        }
+        return v;
+    }
+
+    RowVector bitwise_and(const RowVector &a, const RowVector &b)
+    {
+        RowVector v;
+        for (int p = 0; p < num_parts; p++)
+        {
+            v.parts[p] = _mm_and_si128(a.parts[p], b.parts[p]);
+        }
+        return v;
+    }
+
+    RowVector shift_up(const RowVector &a)
+    {
+        RowVector v;
+        for (int p = 0; p < num_parts; p++)
+        {
+            v.parts[p] = _mm_slli_epi16(a.parts[p], 1);
+        }
+        return v;
+    }
+
+    RowVector shift_down(const RowVector &a)
+    {
+        RowVector v;
+        for (int p = 0; p < num_parts; p++)
+        {
+            v.parts[p] = _mm_srli_epi16(a.parts[p], 1);
+        }
+        return v;
+    }
+
+    LaneMask equal_lanes(const RowVector &a, const RowVector &b)
+    {
+        LaneMask mask = 0;
+        for (int p = 0; p < num_parts; p += 2)
+        {
+            const __m128i packed = _mm_packs_epi16(_mm_cmpeq_epi16(a.parts[p], b.parts[p]),
+                                                   _mm_cmpeq_epi16(a.parts[p + 1], b.parts[p + 1]));
+            mask |= LaneMask(_mm_movemask_epi8(packed)) << (p * lanes_per_part);
+        }
+        return mask;
+    }
+
+    LaneMask nonzero_lanes(const RowVector &v) { return ~equal_lanes(v, zero()); }
+
+    RowVector select(const LaneMask mask, const RowVector &if_clear, const RowVector &if_set)
+    {
+        RowVector v;
+        for (int p = 0; p < num_parts; p++)
+        {
+            const __m128i selected = expand_mask(mask >> (p * lanes_per_part));
+            v.parts[p] = _mm_or_si128(_mm_and_si128(selected, if_set.parts[p]), _mm_andnot_si128(selected, if_clear.parts[p]));
+        }
+        return v;
+    }
+#else
+    struct RowVector
+    {
+        BoardRow lanes[num_lanes];
+    };
+
+    RowVector load(const BoardRow *row)
+    {
+        RowVector v;
+        for (int x = 0; x < num_lanes; x++)
+        {
+            v.lanes[x] = row[x];
+        }
+        return v;
+    }
+
+    void store(BoardRow *row, const RowVector &v)
+    {
+        for (int x = 0; x < num_lanes; x++)
+        {
+            row[x] = v.lanes[x];
+        }
+    }
+
+    RowVector broadcast(const BoardRow value)
+    {
+        RowVector v;
+        for (auto &lane : v.lanes)
+        {
+            lane = value;
+        }
+        return v;
+    }
+
+    RowVector zero() { return broadcast(0); }
+
+    RowVector bitwise_or(const RowVector &a, const RowVector &b)
+    {
+        RowVector v;
+        for (int x = 0; x < num_lanes; x++)
+        {
+            v.lanes[x] = a.lanes[x] | b.lanes[x];
+        }
+        return v;
+    }
+
+    RowVector bitwise_and(const RowVector &a, const RowVector &b)
+    {
+        RowVector v;
+        for (int x = 0; x < num_lanes; x++)
+        {
+            v.lanes[x] = a.lanes[x] & b.lanes[x];
+        }
+        return v;
+    }
+
+    RowVector shift_up(const RowVector &a)
+    {
+        RowVector v;
+        for (int x = 0; x < num_lanes; x++)
+        {
+            v.lanes[x] = a.lanes[x] << 1;
+        }
+        return v;
+    }
+
+    RowVector shift_down(const RowVector &a)
+    {
+        RowVector v;
+        for (int x = 0; x < num_lanes; x++)
+        {
+            v.lanes[x] = a.lanes[x] >> 1;
+        }
+        return v;
+    }
+
+    LaneMask nonzero_lanes(const RowVector &v)
+    {
+        LaneMask mask = 0;
+        for (int x = 0; x < num_lanes; x++)
+        {
+            mask |= LaneMask(v.lanes[x] != 0) << x;
+        }
+        return mask;
+    }
+
+    LaneMask equal_lanes(const RowVector &a, const RowVector &b)
+    {
+        LaneMask mask = 0;
+        for (int x = 0; x < num_lanes; x++)
+        {
+            mask |= LaneMask(a.lanes[x] == b.lanes[x]) << x;
+        }
+        return mask;
+    }
+
+    RowVector select(const LaneMask mask, const RowVector &if_clear, const RowVector &if_set)
+    {
+        RowVector v;
+        for (int x = 0; x < num_lanes; x++)
+        {
+            v.lanes[x] = (mask >> x) & 1 ? if_set.lanes[x] : if_clear.lanes[x];
+        }
+        return v;
+    }
+#endif
+}
+
+using MD = TetrisGame::MovementDirection;
+
+static const int board_height = TetrisGame::board_height;
+static const int board_width = TetrisGame::board_width;
+static const BoardRow full_row = (1 << board_width) - 1;
+
+// Which of the row implementations this build uses.
+const char *LockstepBoards::get_instruction_set()
+{
+#if defined(__AVX512BW__)
+    return "AVX-512BW";
+#elif defined(__AVX2__)
+    return "AVX2";
+#elif defined(__SSE2__)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+void LockstepBoards::clear()
+{
+    for (int i = 0; i < board_height; i++)
+    {
+        board_rows[i].fill(0);
+        piece_rows[i].fill(0);
+    }
+}
+
+void LockstepBoards::set_board(const int lane, const OccupancyBoard &board)
+{
+    for (int i = 0; i < board_height; i++)
+    {
+        board_rows[i][lane] = board[i];
+    }
+}
+
+TetrisGame::OccupancyBoard LockstepBoards::get_board(const int lane)
+{
+    OccupancyBoard board;
+    for (int i = 0; i < board_height; i++)
+    {
+        board[i] = board_rows[i][lane];
+    }
+    return board;
+}
+
+void LockstepBoards::set_piece(const int lane, const PiecePositions &positions)
+{
+    for (int i = 0; i < board_height; i++)
+    {
+        piece_rows[i][lane] = 0;
+    }
+    for (auto [i, j] : positions)
+    {
+        piece_rows[i][lane] |= BoardRow(1) << j;
+    }
+}
+
+// The squares of the lane's falling piece as a board.
+TetrisGame::OccupancyBoard LockstepBoards::get_piece(const int lane)
+{
+    OccupancyBoard piece;
+    for (int i = 0; i < board_height; i++)
+    {
+        piece[i] = piece_rows[i][lane];
+    }
+    return piece;
+}
+
+// Moves the piece in every lane where the move is valid, the same check as
+// TetrisGame::move_piece_if_possible, and returns the lanes that moved.
+LockstepBoards::LaneMask LockstepBoards::move_pieces(const TetrisGame::MovementDirection direction)
+{
+    RowVector moved_rows[board_height];
+    LaneMask blocked = 0;
+    for (int i = 0; i < board_height; i++)
+    {
+        const RowVector piece = load(piece_rows[i].data());
+        switch (direction)
+        {
+        case MD::LEFT:
+            blocked |= nonzero_lanes(bitwise_and(piece, broadcast(1)));
+            moved_rows[i] = shift_down(piece);
+            break;
+        case MD::RIGHT:
+            blocked |= nonzero_lanes(bitwise_and(piece, broadcast(1 << (board_width - 1))));
+            moved_rows[i] = shift_up(piece);
+            break;
+        case MD::DOWN:
+            if (i == 0)
+            {
+                blocked |= nonzero_lanes(piece);
+            }
+            moved_rows[i] = i + 1 < board_height ? load(piece_rows[i + 1].data()) : zero();
+            break;
+        }
+        blocked |= nonzero_lanes(bitwise_and(moved_rows[i], load(board_rows[i].data())));
+    }
+
+    // Collisions for row i are only known once its moved row exists, so the
+    // moved pieces are written back in a second pass.
+    const LaneMask moving = ~blocked;
+    for (int i = 0; i < board_height; i++)
+    {
+        store(piece_rows[i].data(), select(moving, load(piece_rows[i].data()), moved_rows[i]));
+    }
+    return moving;
+}
+
+// Adds the pieces of the given lanes to their boards and removes them as
+// falling pieces.
+void LockstepBoards::lock_pieces(const LaneMask lanes)
+{
+    for (int i = 0; i < board_height; i++)
+    {
+        const RowVector board = load(board_rows[i].data());
+        const RowVector piece = load(piece_rows[i].data());
+        store(board_rows[i].data(), select(lanes, board, bitwise_or(board, piece)));
+        store(piece_rows[i].data(), select(lanes, piece, zero()));
+    }
+}
+
+// Clears every full row in every lane the way TetrisGame::lock_piece does and
+// returns the lanes that cleared anything. Rows are removed from the top down,
+// so the rows below a removed row are never disturbed.
+LockstepBoards::LaneMask LockstepBoards::clear_full_rows(LineClears &line_clears)
+{
+    std::array<LaneMask, board_height> full_lanes;
+    LaneMask any_full = 0;
+    for (int i = 0; i < board_height; i++)
+    {
+        full_lanes[i] = equal_lanes(load(board_rows[i].data()), broadcast(full_row));
+        any_full |= full_lanes[i];
+    }
+
+    line_clears.fill(LineClear());
+    if (!any_full)
+    {
+        return 0;
+    }
+
+    for (int i = board_height - 1; i >= 0; i--)
+    {
+        const LaneMask lanes = full_lanes[i];
+        if (!lanes)
+        {
+            continue;
+        }
+        for (int k = i; k < board_height - 1; k++)
+        {
+            store(board_rows[k].data(), select(lanes, load(board_rows[k].data()), load(board_rows[k + 1].data())));
+        }
+        store(board_rows[board_height - 1].data(), select(lanes, load(board_rows[board_height - 1].data()), zero()));
+
+        for (int lane = 0; lane < num_lanes; lane++)
+        {
+            if ((lanes >> lane) & 1)
+            {
+                line_clears[lane].cleared_rows |= uint32_t(1) << i;
+                line_clears[lane].num_lines_cleared++;
+            }
+        }
+    }
+    return any_full;
+}
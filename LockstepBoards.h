@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "TetrisGame.h"
+
+// The occupancy boards and falling pieces of num_lanes games, stored row by
+// row with each row holding that row of every game side by side, so one
+// operation can be applied to every game at once with vector instructions.
+// Pieces are kept as a board-sized mask like the locked squares, which makes
+// every move the same shift for every game. Moves, locking and line clears
+// follow TetrisGame's rules exactly. AVX-512BW or AVX2 is used when the
+// compiler targets it, SSE2 otherwise on x86-64 and plain loops elsewhere.
+class LockstepBoards
+{
+public:
+    static const int num_lanes = 32;
+
+    using BoardRow = TetrisGame::BoardRow;
+    using OccupancyBoard = TetrisGame::OccupancyBoard;
+    using PiecePositions = TetrisGame::PiecePositions;
+    using LineClear = TetrisGame::LineClear;
+    // One bit per game, bit x for lane x.
+    using LaneMask = uint32_t;
+    using LineClears = std::array<LineClear, num_lanes>;
+
+    static const char *get_instruction_set();
+    void clear();
+    void set_board(const int, const OccupancyBoard &);
+    OccupancyBoard get_board(const int);
+    void set_piece(const int, const PiecePositions &);
+    OccupancyBoard get_piece(const int);
+    LaneMask move_pieces(const TetrisGame::MovementDirection);
+    void lock_pieces(const LaneMask);
+    LaneMask clear_full_rows(LineClears &);
+
+private:
+    using LaneRow = std::array<BoardRow, num_lanes>;
+
+    static_assert(num_lanes == 8 * sizeof(LaneMask), "a LaneMask must have a bit per lane");
+
+    alignas(64) std::array<LaneRow, TetrisGame::board_height> board_rows = {};
+    alignas(64) std::array<LaneRow, TetrisGame::board_height> piece_rows = {};
+};
@@ -0,0 +1,154 @@
+#include "MatchProtocol.h"
+
+// STATE payload: flags (bit 0 game over, bit 1 a piece is held), falling
+// piece, held piece, upcoming pieces, score, number of changed rows, then a
+// row index and the row's bits for each changed row.
+
+namespace
+{
+    const uint8_t game_over_flag = 1;
+    const uint8_t piece_held_flag = 2;
+    const int state_fixed_size = 3 + TetrisGame::num_upcoming_pieces_shown + 4 + 1;
+    const int bytes_per_changed_row = 3;
+
+    static_assert(state_fixed_size + TetrisGame::board_height * bytes_per_changed_row <= MatchProtocol::max_payload_size,
+                  "a STATE frame with every row changed must fit in a frame");
+
+    template <typename T>
+    void store_little_endian(uint8_t *bytes, const T value)
+    {
+        for (size_t x = 0; x < sizeof(T); x++)
+        {
+            bytes[x] = static_cast<uint8_t>((value >> (8 * x)) & 0xFF);
+        }
+    }
+
+    template <typename T>
+    T load_little_endian(const uint8_t *bytes)
+    {
+        T value = 0;
+        for (size_t x = 0; x < sizeof(T); x++)
+        {
+            value |= static_cast<T>(bytes[x]) << (8 * x);
+        }
+        return value;
+    }
+}
+
+// Each write_ function fills a frame at the start of the buffer, which needs
+// max_frame_size bytes, and returns its size.
+int MatchProtocol::write_start(uint8_t *frame, const uint64_t seed, const PieceRandomizer::Policy policy)
+{
+    frame[0] = static_cast<uint8_t>(FrameType::START);
+    frame[1] = start_payload_size;
+    store_little_endian(frame + header_size, seed);
+    frame[header_size + 8] = static_cast<uint8_t>(policy);
+    return header_size + start_payload_size;
+}
+
+int MatchProtocol::write_inputs(uint8_t *frame, const Replay::Input *inputs, const int num_inputs)
+{
+    frame[0] = static_cast<uint8_t>(FrameType::INPUTS);
+    frame[1] = uint8_t(num_inputs);
+    for (int x = 0; x < num_inputs; x++)
+    {
+        frame[header_size + x] = static_cast<uint8_t>(inputs[x]);
+    }
+    return header_size + num_inputs;
+}
+
+// Writes the game's state as a change from sent_rows, the rows in the last
+// STATE frame sent, and updates sent_rows.
+int MatchProtocol::write_state(uint8_t *frame, TetrisGame &game, TetrisGame::OccupancyBoard &sent_rows)
+{
+    const GameView view = get_view(game);
+    uint8_t *payload = frame + header_size;
+    payload[0] = (view.game_is_over ? game_over_flag : 0) | (view.held_piece != GameView::no_piece ? piece_held_flag : 0);
+    payload[1] = view.falling_piece;
+    payload[2] = view.held_piece;
+    for (int x = 0; x < TetrisGame::num_upcoming_pieces_shown; x++)
+    {
+        payload[3 + x] = view.upcoming_pieces[x];
+    }
+    store_little_endian(payload + 3 + TetrisGame::num_upcoming_pieces_shown, view.score);
+
+    int num_changed_rows = 0;
+    uint8_t *changed_rows = payload + state_fixed_size;
+    for (int i = 0; i < TetrisGame::board_height; i++)
+    {
+        if (view.rows[i] != sent_rows[i])
+        {
+            changed_rows[num_changed_rows * bytes_per_changed_row] = uint8_t(i);
+            store_little_endian(changed_rows + num_changed_rows * bytes_per_changed_row + 1, view.rows[i]);
+            num_changed_rows++;
+        }
+    }
+    payload[state_fixed_size - 1] = uint8_t(num_changed_rows);
+    sent_rows = view.rows;
+
+    frame[0] = static_cast<uint8_t>(FrameType::STATE);
+    frame[1] = uint8_t(state_fixed_size + num_changed_rows * bytes_per_changed_row);
+    return header_size + frame[1];
+}
+
+// The read_ functions take a frame's payload. They return false if it is
+// malformed.
+bool MatchProtocol::read_start(const uint8_t *payload, const int payload_size, uint64_t &seed, PieceRandomizer::Policy &policy)
+{
+    if (payload_size != start_payload_size || payload[8] > static_cast<uint8_t>(PieceRandomizer::Policy::UNIFORM))
+    {
+        return false;
+    }
+    seed = load_little_endian<uint64_t>(payload);
+    policy = static_cast<PieceRandomizer::Policy>(payload[8]);
+    return true;
+}
+
+bool MatchProtocol::read_state(const uint8_t *payload, const int payload_size, GameView &view)
+{
+    if (payload_size < state_fixed_size ||
+        payload_size != state_fixed_size + payload[state_fixed_size - 1] * bytes_per_changed_row)
+    {
+        return false;
+    }
+
+    view.game_is_over = payload[0] & game_over_flag;
+    view.falling_piece = payload[1];
+    view.held_piece = payload[2];
+    for (int x = 0; x < TetrisGame::num_upcoming_pieces_shown; x++)
+    {
+        view.upcoming_pieces[x] = payload[3 + x];
+    }
+    view.score = load_little_endian<uint32_t>(payload + 3 + TetrisGame::num_upcoming_pieces_shown);
+
+    const uint8_t *changed_rows = payload + state_fixed_size;
+    for (int x = 0; x < payload[state_fixed_size - 1]; x++)
+    {
+        const int i = changed_rows[x * bytes_per_changed_row];
+        if (i >= TetrisGame::board_height)
+        {
+            return false;
+        }
+        view.rows[i] = load_little_endian<uint16_t>(changed_rows + x * bytes_per_changed_row + 1);
+    }
+    return true;
+}
+
+MatchProtocol::GameView MatchProtocol::get_view(TetrisGame &game)
+{
+    GameView view;
+    view.rows = game.get_locked_rows();
+    for (auto [i, j] : game.get_falling_piece().positions)
+    {
+        view.rows[i] |= TetrisGame::BoardRow(1) << j;
+    }
+    view.falling_piece = static_cast<uint8_t>(game.get_falling_piece().type);
+    view.held_piece = game.get_whether_a_piece_is_held() ? static_cast<uint8_t>(game.get_held_piece()) : GameView::no_piece;
+    for (int x = 0; x < TetrisGame::num_upcoming_pieces_shown; x++)
+    {
+        view.upcoming_pieces[x] = static_cast<uint8_t>(game.get_upcoming_piece(x));
+    }
+    view.score = game.get_score();
+    view.game_is_over = game.get_whether_the_game_is_over();
+    return view;
+}
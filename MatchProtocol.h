@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+#include "TetrisGame.h"
+
+// The binary protocol between match_server and its clients. Every frame is a
+// type byte, a payload size byte and the payload, with multi-byte fields little
+// endian. A client sends START to begin a game and INPUTS frames of
+// Replay::Input bytes to play it, and gets one STATE frame back for each. A
+// STATE frame only carries the board rows that changed since the last one, so
+// a frame for a move is usually a few rows plus the pieces and score.
+class MatchProtocol
+{
+public:
+    enum class FrameType : uint8_t
+    {
+        START,
+        INPUTS,
+        STATE
+    };
+
+    static const int header_size = 2;
+    static const int max_payload_size = 255;
+    static const int max_frame_size = header_size + max_payload_size;
+    static const int start_payload_size = 9;
+    static const int max_inputs_per_frame = max_payload_size;
+
+    // A client's copy of its game, kept up to date from STATE frames. Rows
+    // include the falling piece and pieces are TetrisGame::PieceType values,
+    // with no_piece for an empty hold.
+    struct GameView
+    {
+        static const uint8_t no_piece = TetrisGame::num_piece_types;
+
+        TetrisGame::OccupancyBoard rows = {};
+        uint8_t falling_piece = 0;
+        uint8_t held_piece = no_piece;
+        uint8_t upcoming_pieces[TetrisGame::num_upcoming_pieces_shown] = {};
+        uint32_t score = 0;
+        bool game_is_over = false;
+    };
+
+    static int write_start(uint8_t *, const uint64_t, const PieceRandomizer::Policy);
+    static int write_inputs(uint8_t *, const Replay::Input *, const int);
+    static int write_state(uint8_t *, TetrisGame &, TetrisGame::OccupancyBoard &);
+    static bool read_start(const uint8_t *, const int, uint64_t &, PieceRandomizer::Policy &);
+    static bool read_state(const uint8_t *, const int, GameView &);
+    static GameView get_view(TetrisGame &);
+};
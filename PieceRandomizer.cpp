@@ -0,0 +1,203 @@
+#include "PieceRandomizer.h"
+
+namespace
+{
+    uint64_t splitmix64(uint64_t &state)
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t rotl(const uint64_t x, const int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+}
+
+PieceRandomizer::PieceRandomizer() : PieceRandomizer(0, Policy::SEVEN_BAG)
+{
+}
+
+PieceRandomizer::PieceRandomizer(uint64_t seed, Policy policy) : seed(seed), policy(policy)
+{
+    uint64_t splitmix_state = seed;
+    for (auto &word : rng_state)
+    {
+        word = splitmix64(splitmix_state);
+    }
+    fill_ring();
+}
+
+uint64_t PieceRandomizer::get_seed()
+{
+    return seed;
+}
+
+PieceRandomizer::Policy PieceRandomizer::get_policy()
+{
+    return policy;
+}
+
+uint32_t PieceRandomizer::get_num_pieces_dealt()
+{
+    return num_pieces_dealt;
+}
+
+int PieceRandomizer::next()
+{
+    fill_ring();
+    int piece = ring[ring_start];
+    ring_start = (ring_start + 1) & (ring_capacity - 1);
+    ring_size--;
+    num_pieces_dealt++;
+    return piece;
+}
+
+int PieceRandomizer::peek(const int i)
+{
+    return ring[(ring_start + i) & (ring_capacity - 1)];
+}
+
+void PieceRandomizer::fill_ring()
+{
+    while (ring_size <= min_lookahead)
+    {
+        refill();
+    }
+}
+
+// A policy value outside the enum deals seven-bag, so the ring always fills.
+void PieceRandomizer::refill()
+{
+    switch (policy)
+    {
+    case Policy::FOURTEEN_BAG:
+        generate_bag(2);
+        break;
+    case Policy::TGM_HISTORY:
+        generate_tgm_history_batch();
+        break;
+    case Policy::UNIFORM:
+        generate_uniform_batch();
+        break;
+    case Policy::SEVEN_BAG:
+    default:
+        generate_bag(1);
+        break;
+    }
+}
+
+void PieceRandomizer::push(const uint8_t piece)
+{
+    ring[(ring_start + ring_size) & (ring_capacity - 1)] = piece;
+    ring_size++;
+}
+
+void PieceRandomizer::generate_bag(const int copies_of_each_piece)
+{
+    std::array<uint8_t, 2 * num_piece_types> bag;
+    const int bag_size = copies_of_each_piece * num_piece_types;
+    for (int x = 0; x < bag_size; x++)
+    {
+        bag[x] = x % num_piece_types;
+    }
+
+    for (int x = bag_size - 1; x > 0; x--)
+    {
+        std::swap(bag[x], bag[random_below(x + 1)]);
+    }
+
+    for (int x = 0; x < bag_size; x++)
+    {
+        push(bag[x]);
+    }
+}
+
+void PieceRandomizer::generate_tgm_history_batch()
+{
+    for (int x = 0; x < pieces_per_batch; x++)
+    {
+        uint8_t piece = roll_tgm_history_piece();
+        for (int y = tgm_history_length - 1; y > 0; y--)
+        {
+            tgm_history[y] = tgm_history[y - 1];
+        }
+        tgm_history[0] = piece;
+        push(piece);
+    }
+}
+
+uint8_t PieceRandomizer::roll_tgm_history_piece()
+{
+    if (tgm_first_piece)
+    {
+        tgm_first_piece = false;
+        uint8_t piece;
+        do
+        {
+            piece = random_below(num_piece_types);
+        } while (piece == piece_O || piece == piece_S || piece == piece_Z);
+        return piece;
+    }
+
+    uint8_t piece = random_below(num_piece_types);
+    for (int roll = 1; roll < tgm_rolls; roll++)
+    {
+        bool in_history = false;
+        for (auto recent_piece : tgm_history)
+        {
+            in_history |= recent_piece == piece;
+        }
+        if (!in_history)
+        {
+            break;
+        }
+        piece = random_below(num_piece_types);
+    }
+    return piece;
+}
+
+void PieceRandomizer::generate_uniform_batch()
+{
+    for (int x = 0; x < pieces_per_batch; x++)
+    {
+        push(random_below(num_piece_types));
+    }
+}
+
+// xoshiro256**
+uint64_t PieceRandomizer::next_random()
+{
+    const uint64_t result = rotl(rng_state[1] * 5, 7) * 9;
+    const uint64_t t = rng_state[1] << 17;
+
+    rng_state[2] ^= rng_state[0];
+    rng_state[3] ^= rng_state[1];
+    rng_state[1] ^= rng_state[2];
+    rng_state[0] ^= rng_state[3];
+
+    rng_state[2] ^= t;
+    rng_state[3] = rotl(rng_state[3], 45);
+
+    return result;
+}
+
+// Lemire's nearly divisionless method, so the result is unbiased and the
+// same on every platform.
+uint32_t PieceRandomizer::random_below(const uint32_t bound)
+{
+    uint64_t product = (next_random() >> 32) * bound;
+    uint32_t low = static_cast<uint32_t>(product);
+    if (low < bound)
+    {
+        const uint32_t threshold = -bound % bound;
+        while (low < threshold)
+        {
+            product = (next_random() >> 32) * bound;
+            low = static_cast<uint32_t>(product);
+        }
+    }
+    return static_cast<uint32_t>(product >> 32);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// Produces the sequence of pieces for a game from an explicit 64-bit seed.
+// Pieces are identified by their index in TetrisGame::PieceType and are
+// generated a whole bag at a time into a fixed ring, so peek() can always
+// look min_lookahead pieces ahead without generating anything.
+class PieceRandomizer
+{
+public:
+    static const int num_piece_types = 7;
+    static const int ring_capacity = 32;
+    static const int min_lookahead = 16;
+
+    enum class Policy : uint8_t
+    {
+        SEVEN_BAG,
+        FOURTEEN_BAG,
+        TGM_HISTORY,
+        UNIFORM
+    };
+
+    PieceRandomizer();
+    PieceRandomizer(uint64_t, Policy);
+    int next();
+    int peek(const int);
+    uint64_t get_seed();
+    Policy get_policy();
+    uint32_t get_num_pieces_dealt();
+
+private:
+    // Piece indices the TGM history policy treats specially.
+    static const uint8_t piece_O = 3;
+    static const uint8_t piece_S = 4;
+    static const uint8_t piece_Z = 5;
+
+    static const int tgm_history_length = 4;
+    static const int tgm_rolls = 6;
+    static const int pieces_per_batch = 7;
+
+    static_assert((ring_capacity & (ring_capacity - 1)) == 0, "ring_capacity must be a power of two");
+    static_assert(min_lookahead + 2 * num_piece_types < ring_capacity, "a refill must fit in the ring");
+
+    uint64_t seed;
+    Policy policy;
+    std::array<uint64_t, 4> rng_state;
+    std::array<uint8_t, ring_capacity> ring;
+    uint8_t ring_start = 0;
+    uint8_t ring_size = 0;
+    uint32_t num_pieces_dealt = 0;
+    std::array<uint8_t, tgm_history_length> tgm_history = {piece_Z, piece_S, piece_S, piece_Z};
+    bool tgm_first_piece = true;
+
+    uint64_t next_random();
+    uint32_t random_below(const uint32_t);
+    void fill_ring();
+    void refill();
+    void push(const uint8_t);
+    void generate_bag(const int);
+    void generate_tgm_history_batch();
+    uint8_t roll_tgm_history_piece();
+    void generate_uniform_batch();
+};
@@ -0,0 +1,161 @@
+#include <algorithm>
+
+#include "PlacementGenerator.h"
+
+using MD = TetrisGame::MovementDirection;
+using RD = TetrisGame::RotationDirection;
+
+int PlacementGenerator::generate(TetrisGame &game)
+{
+    return generate(game.get_locked_rows(), game.get_falling_piece());
+}
+
+// Breadth-first search over piece states. A state is a placement when the
+// piece cannot move down from it.
+//
+// Well above the stack every input does the same thing whatever the height,
+// so soft drops there skip straight down to sky_floor_row instead of visiting
+// every row on the way. Below that row the search takes one step at a time,
+// which is where tucks and kicks off the stack are found.
+int PlacementGenerator::generate(const OccupancyBoard &locked_rows, const FallingPiece &start)
+{
+    visited.fill(0);
+    num_nodes = 0;
+    num_placements = 0;
+
+    if (!TetrisGame::positions_are_valid(locked_rows, start.positions))
+    {
+        return 0;
+    }
+
+    int stack_top_row = TetrisGame::board_height - 1;
+    while (stack_top_row >= 0 && locked_rows[stack_top_row] == 0)
+    {
+        stack_top_row--;
+    }
+    sky_floor_row = stack_top_row + sky_margin;
+
+    path_lengths[0] = 0;
+    visit(start, 0, Input::SOFT_DROP, 0);
+
+    for (int node = 0; node < num_nodes; node++)
+    {
+        const FallingPiece current = nodes[node];
+
+        for (auto input : search_inputs)
+        {
+            FallingPiece next = current;
+            if (apply_search_input(locked_rows, next, input))
+            {
+                visit(next, node, input, 1);
+            }
+        }
+
+        FallingPiece next = current;
+        const int rows_to_drop = std::max(get_lowest_row(current) - sky_floor_row, 1);
+        if (rows_to_drop > 1)
+        {
+            for (auto &position : next.positions)
+            {
+                position.i -= rows_to_drop;
+            }
+            visit(next, node, Input::SOFT_DROP, rows_to_drop);
+        }
+        else if (TetrisGame::move_piece_if_possible(locked_rows, next, MD::DOWN))
+        {
+            visit(next, node, Input::SOFT_DROP, 1);
+        }
+        else
+        {
+            placements[num_placements] = node;
+            num_placements++;
+        }
+    }
+
+    return num_placements;
+}
+
+bool PlacementGenerator::apply_search_input(const OccupancyBoard &locked_rows, FallingPiece &piece, const Input input)
+{
+    switch (input)
+    {
+    case Input::LEFT:
+        return TetrisGame::move_piece_if_possible(locked_rows, piece, MD::LEFT);
+    case Input::RIGHT:
+        return TetrisGame::move_piece_if_possible(locked_rows, piece, MD::RIGHT);
+    case Input::ROTATE_LEFT:
+        return TetrisGame::rotate_piece_if_possible(locked_rows, piece, RD::LEFT);
+    case Input::ROTATE_RIGHT:
+        return TetrisGame::rotate_piece_if_possible(locked_rows, piece, RD::RIGHT);
+    default:
+        return false;
+    }
+}
+
+int PlacementGenerator::get_lowest_row(const FallingPiece &piece)
+{
+    int lowest_row = piece.positions[0].i;
+    for (const auto &position : piece.positions)
+    {
+        lowest_row = std::min(lowest_row, int(position.i));
+    }
+    return lowest_row;
+}
+
+void PlacementGenerator::visit(const FallingPiece &piece, const NodeIndex parent, const Input input, const int repeats)
+{
+    const int state_index = get_state_index(piece);
+    uint64_t &visited_word = visited[state_index / 64];
+    const uint64_t visited_bit = uint64_t(1) << (state_index % 64);
+    if (visited_word & visited_bit)
+    {
+        return;
+    }
+    visited_word |= visited_bit;
+
+    nodes[num_nodes] = piece;
+    parents[num_nodes] = parent;
+    inputs_from_parent[num_nodes] = input;
+    input_repeats[num_nodes] = repeats;
+    path_lengths[num_nodes] = path_lengths[parent] + repeats;
+    num_nodes++;
+}
+
+int PlacementGenerator::get_state_index(const FallingPiece &piece)
+{
+    const auto [i, j] = piece.positions[0];
+    return (static_cast<int>(piece.rotation_state) * TetrisGame::board_height + i) * TetrisGame::board_width + j;
+}
+
+int PlacementGenerator::get_num_placements()
+{
+    return num_placements;
+}
+
+const PlacementGenerator::FallingPiece &PlacementGenerator::get_placement(const int placement_index)
+{
+    return nodes[placements[placement_index]];
+}
+
+int PlacementGenerator::get_path_length(const int placement_index)
+{
+    return path_lengths[placements[placement_index]];
+}
+
+// Writes the inputs that move the piece from the starting position to the
+// placement, which needs room for get_path_length() inputs. The placement is
+// then locked with a hard drop.
+void PlacementGenerator::get_path(const int placement_index, Input *path)
+{
+    NodeIndex node = placements[placement_index];
+    int x = path_lengths[node];
+    while (x > 0)
+    {
+        for (int repeat = 0; repeat < input_repeats[node]; repeat++)
+        {
+            x--;
+            path[x] = inputs_from_parent[node];
+        }
+        node = parents[node];
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "TetrisGame.h"
+
+// Finds every resting placement a piece can reach using the game's own
+// movement and rotation rules, kicks included, so tucks and spins are found
+// along with plain drops. Each placement comes with a sequence of inputs that
+// reaches it from the starting position. All working storage is
+// fixed-size, so a generator can be reused for any number of searches without
+// allocating.
+class PlacementGenerator
+{
+public:
+    using Input = Replay::Input;
+    using FallingPiece = TetrisGame::FallingPiece;
+    using OccupancyBoard = TetrisGame::OccupancyBoard;
+
+    // A piece state is its rotation plus the position of its first square,
+    // which together determine all four of its squares.
+    static const int num_piece_states = 4 * TetrisGame::board_height * TetrisGame::board_width;
+
+    int generate(const OccupancyBoard &, const FallingPiece &);
+    int generate(TetrisGame &);
+    int get_num_placements();
+    const FallingPiece &get_placement(const int);
+    int get_path_length(const int);
+    void get_path(const int, Input *);
+
+private:
+    using NodeIndex = uint16_t;
+
+    // No single move or rotation, kicks included, shifts a square down by
+    // more than this many rows.
+    static const int sky_margin = 5;
+
+    static constexpr std::array<Input, 4> search_inputs = {
+        Input::LEFT,
+        Input::RIGHT,
+        Input::ROTATE_RIGHT,
+        Input::ROTATE_LEFT,
+    };
+
+    std::array<uint64_t, (num_piece_states + 63) / 64> visited;
+    std::array<FallingPiece, num_piece_states> nodes;
+    std::array<NodeIndex, num_piece_states> parents;
+    std::array<Input, num_piece_states> inputs_from_parent;
+    std::array<uint8_t, num_piece_states> input_repeats;
+    std::array<uint16_t, num_piece_states> path_lengths;
+    std::array<NodeIndex, num_piece_states> placements;
+    int num_nodes = 0;
+    int num_placements = 0;
+    int sky_floor_row = 0;
+
+    static int get_state_index(const FallingPiece &);
+    static int get_lowest_row(const FallingPiece &);
+    static bool apply_search_input(const OccupancyBoard &, FallingPiece &, const Input);
+    void visit(const FallingPiece &, const NodeIndex, const Input, const int);
+};
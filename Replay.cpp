@@ -0,0 +1,119 @@
+#include <fstream>
+
+#include "Replay.h"
+#include "TetrisGame.h"
+
+namespace
+{
+    template <typename T>
+    void write_little_endian(std::ofstream &file, const T value)
+    {
+        for (size_t x = 0; x < sizeof(T); x++)
+        {
+            file.put(static_cast<char>((value >> (8 * x)) & 0xFF));
+        }
+    }
+
+    template <typename T>
+    T read_little_endian(std::ifstream &file)
+    {
+        T value = 0;
+        for (size_t x = 0; x < sizeof(T); x++)
+        {
+            value |= static_cast<T>(static_cast<uint8_t>(file.get())) << (8 * x);
+        }
+        return value;
+    }
+}
+
+Replay::Replay()
+{
+}
+
+Replay::Replay(uint64_t seed, PieceRandomizer::Policy policy) : seed(seed), policy(policy)
+{
+}
+
+uint64_t Replay::get_seed() const
+{
+    return seed;
+}
+
+PieceRandomizer::Policy Replay::get_policy() const
+{
+    return policy;
+}
+
+uint64_t Replay::get_num_inputs() const
+{
+    return num_inputs;
+}
+
+void Replay::record(const Input input)
+{
+    num_inputs++;
+    if (!runs.empty())
+    {
+        uint8_t &last_run = runs.back();
+        if ((last_run & input_mask) == static_cast<uint8_t>(input) && (last_run >> input_bits) < max_run_length - 1)
+        {
+            last_run += 1 << input_bits;
+            return;
+        }
+    }
+    runs.push_back(static_cast<uint8_t>(input));
+}
+
+void Replay::play(TetrisGame &game) const
+{
+    for (auto run : runs)
+    {
+        const auto input = static_cast<Input>(run & input_mask);
+        for (int run_length = (run >> input_bits) + 1; run_length > 0; run_length--)
+        {
+            game.apply_input(input);
+        }
+    }
+}
+
+bool Replay::save(const std::string &filename) const
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    write_little_endian(file, file_magic);
+    write_little_endian(file, file_version);
+    write_little_endian(file, static_cast<uint8_t>(policy));
+    write_little_endian(file, seed);
+    write_little_endian(file, num_inputs);
+    write_little_endian(file, static_cast<uint64_t>(runs.size()));
+    file.write(reinterpret_cast<const char *>(runs.data()), runs.size());
+    return static_cast<bool>(file);
+}
+
+bool Replay::load(const std::string &filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file ||
+        read_little_endian<uint32_t>(file) != file_magic ||
+        read_little_endian<uint8_t>(file) != file_version)
+    {
+        return false;
+    }
+
+    const auto policy_byte = read_little_endian<uint8_t>(file);
+    seed = read_little_endian<uint64_t>(file);
+    num_inputs = read_little_endian<uint64_t>(file);
+    const auto num_runs = read_little_endian<uint64_t>(file);
+    if (!file || policy_byte > static_cast<uint8_t>(PieceRandomizer::Policy::UNIFORM) || num_runs > num_inputs)
+    {
+        return false;
+    }
+    policy = static_cast<PieceRandomizer::Policy>(policy_byte);
+    runs.resize(num_runs);
+    file.read(reinterpret_cast<char *>(runs.data()), runs.size());
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "PieceRandomizer.h"
+
+class TetrisGame;
+
+// A recording of every input given to a TetrisGame, enough to re-simulate it
+// exactly from its seed. Inputs are stored as runs of identical inputs, one
+// byte per run (input in the low bits, run length minus one in the high
+// bits), so the long stretches of ITERATE_TIME ticks between player inputs
+// cost one byte per 32 ticks.
+class Replay
+{
+public:
+    enum class Input : uint8_t
+    {
+        LEFT,
+        RIGHT,
+        ROTATE_LEFT,
+        ROTATE_RIGHT,
+        SOFT_DROP,
+        HARD_DROP,
+        HOLD,
+        ITERATE_TIME
+    };
+
+    Replay();
+    Replay(uint64_t, PieceRandomizer::Policy);
+    void record(const Input);
+    void play(TetrisGame &) const;
+    uint64_t get_seed() const;
+    PieceRandomizer::Policy get_policy() const;
+    uint64_t get_num_inputs() const;
+    bool save(const std::string &) const;
+    bool load(const std::string &);
+
+private:
+    static const int input_bits = 3;
+    static const uint8_t input_mask = (1 << input_bits) - 1;
+    static const int max_run_length = 1 << (8 - input_bits);
+    static const uint32_t file_magic = 0x4C505254; // "TRPL"
+    static const uint8_t file_version = 1;
+
+    uint64_t seed = 0;
+    PieceRandomizer::Policy policy = PieceRandomizer::Policy::SEVEN_BAG;
+    uint64_t num_inputs = 0;
+    std::vector<uint8_t> runs;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// A fixed-capacity queue from exactly one producer thread to exactly one
+// consumer thread, without locks. Each side only writes its own index, and
+// the two indices sit on separate cache lines so pushing and popping don't
+// fight over one.
+template <typename T, int capacity>
+class SpscQueue
+{
+public:
+    // Returns false, dropping the item, when the queue is full.
+    bool push(const T &item)
+    {
+        const uint32_t tail_index = tail.load(std::memory_order_relaxed);
+        if (tail_index - head.load(std::memory_order_acquire) == capacity)
+        {
+            return false;
+        }
+        items[tail_index % capacity] = item;
+        tail.store(tail_index + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        const uint32_t head_index = head.load(std::memory_order_relaxed);
+        if (head_index == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = items[head_index % capacity];
+        head.store(head_index + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    static_assert(capacity > 0 && (capacity & (capacity - 1)) == 0, "the indices wrap around, so the capacity must be a power of two");
+
+    // Both indices count up forever; the slot is the index modulo capacity.
+    alignas(64) std::atomic<uint32_t> head{0};
+    alignas(64) std::atomic<uint32_t> tail{0};
+    alignas(64) std::array<T, capacity> items;
+};
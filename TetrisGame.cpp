@@ -1,19 +1,72 @@
 #include <algorithm>
-#include <random>
 #include <chrono>
 #include <iostream>
+#include <type_traits>
+#include <vector>
 
 #include "TetrisGame.h"
 
-template <typename T>
-T top_and_pop(std::queue<T> &queue)
+static_assert(static_cast<int>(TetrisGame::PieceType::O) == 3 &&
+                  static_cast<int>(TetrisGame::PieceType::S) == 4 &&
+                  static_cast<int>(TetrisGame::PieceType::Z) == 5,
+              "PieceRandomizer hardcodes the O, S and Z piece indices");
+
+// Counts the set bits without relying on compiler builtins.
+static int count_bits(uint32_t bits)
 {
-    T top = queue.front();
-    queue.pop();
-    return top;
+    bits = bits - ((bits >> 1) & 0x55555555);
+    bits = (bits & 0x33333333) + ((bits >> 2) & 0x33333333);
+    return (((bits + (bits >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
 }
 
-TetrisGame::TetrisGame()
+namespace
+{
+    struct ZobristKeys
+    {
+        std::array<std::array<uint64_t, TetrisGame::board_width>, TetrisGame::board_height> squares;
+        std::array<uint64_t, TetrisGame::num_piece_types> falling_piece;
+        std::array<uint64_t, TetrisGame::num_piece_types> held_piece;
+    };
+
+    constexpr uint64_t splitmix64(uint64_t &state)
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    constexpr ZobristKeys make_zobrist_keys()
+    {
+        ZobristKeys keys = {};
+        uint64_t state = 0x5A0B815748A54D21ULL;
+        for (auto &row : keys.squares)
+        {
+            for (auto &key : row)
+            {
+                key = splitmix64(state);
+            }
+        }
+        for (int x = 0; x < TetrisGame::num_piece_types; x++)
+        {
+            keys.falling_piece[x] = splitmix64(state);
+            keys.held_piece[x] = splitmix64(state);
+        }
+        return keys;
+    }
+
+    constexpr ZobristKeys zobrist_keys = make_zobrist_keys();
+}
+
+static_assert(std::is_trivially_copyable<TetrisGame::GameState>::value, "GameState must be copyable with memcpy");
+static_assert(std::is_trivially_copyable<TetrisGame::SearchState>::value && sizeof(TetrisGame::SearchState) <= 128,
+              "SearchState must be a small plain value");
+
+TetrisGame::TetrisGame() : TetrisGame(std::chrono::system_clock::now().time_since_epoch().count())
+{
+}
+
+TetrisGame::TetrisGame(uint64_t seed, PieceRandomizer::Policy policy) : randomizer(seed, policy)
 {
     initialize_game();
 }
@@ -33,24 +86,251 @@ bool TetrisGame::get_whether_a_piece_is_held()
     return a_piece_is_held;
 }
 
+// The game is over once a piece spawns overlapping locked squares. Nothing
+// stops play afterwards; it is up to the caller to stop.
+bool TetrisGame::get_whether_the_game_is_over()
+{
+    return game_is_over;
+}
+
+uint64_t TetrisGame::get_seed()
+{
+    return randomizer.get_seed();
+}
+
+PieceRandomizer::Policy TetrisGame::get_policy()
+{
+    return randomizer.get_policy();
+}
+
+void TetrisGame::record_inputs_to(Replay *new_replay)
+{
+    replay = new_replay;
+}
+
+void TetrisGame::set_lock_observer(LockObserver *new_lock_observer)
+{
+    lock_observer = new_lock_observer;
+}
+
+void TetrisGame::record_input(const Replay::Input input)
+{
+    if (replay)
+    {
+        replay->record(input);
+    }
+}
+
+TetrisGame::GameState TetrisGame::snapshot()
+{
+    GameState state;
+    state.occupied_rows = occupied_rows;
+    state.color_rows = color_rows;
+    state.column_heights = column_heights;
+    state.board_features = board_features;
+    state.falling_piece = falling_piece;
+    state.randomizer = randomizer;
+    state.held_piece = held_piece;
+    state.a_piece_is_held = a_piece_is_held;
+    state.a_piece_was_held_this_turn = a_piece_was_held_this_turn;
+    state.game_is_over = game_is_over;
+    state.score = score;
+    state.last_line_clear = last_line_clear;
+    state.line_clear_counts = line_clear_counts;
+    state.hash = hash;
+    return state;
+}
+
+void TetrisGame::restore(const GameState &state)
+{
+    occupied_rows = state.occupied_rows;
+    color_rows = state.color_rows;
+    column_heights = state.column_heights;
+    board_features = state.board_features;
+    falling_piece = state.falling_piece;
+    randomizer = state.randomizer;
+    held_piece = state.held_piece;
+    a_piece_is_held = state.a_piece_is_held;
+    a_piece_was_held_this_turn = state.a_piece_was_held_this_turn;
+    game_is_over = state.game_is_over;
+    score = state.score;
+    last_line_clear = state.last_line_clear;
+    line_clear_counts = state.line_clear_counts;
+    hash = state.hash;
+}
+
+TetrisGame::SearchState TetrisGame::search_snapshot()
+{
+    SearchState state;
+    state.hash = hash;
+    state.occupied_rows = occupied_rows;
+    state.last_line_clear = last_line_clear;
+    state.score = score;
+    state.num_pieces_dealt = randomizer.get_num_pieces_dealt();
+    state.falling_piece = falling_piece;
+    state.held_piece = held_piece;
+    state.a_piece_is_held = a_piece_is_held;
+    state.a_piece_was_held_this_turn = a_piece_was_held_this_turn;
+    state.game_is_over = game_is_over;
+    return state;
+}
+
+// origin must be a snapshot of this game's line of play from no later than
+// the search state, so dealing on from its randomizer deals the same pieces.
+void TetrisGame::restore(const SearchState &state, const GameState &origin)
+{
+    occupied_rows = state.occupied_rows;
+    falling_piece = state.falling_piece;
+    held_piece = state.held_piece;
+    a_piece_is_held = state.a_piece_is_held;
+    a_piece_was_held_this_turn = state.a_piece_was_held_this_turn;
+    game_is_over = state.game_is_over;
+    score = state.score;
+    last_line_clear = state.last_line_clear;
+    line_clear_counts = origin.line_clear_counts;
+    hash = state.hash;
+
+    randomizer = origin.randomizer;
+    while (randomizer.get_num_pieces_dealt() < state.num_pieces_dealt)
+    {
+        randomizer.next();
+    }
+
+    const auto locked_rows = get_locked_rows();
+    for (int i = 0; i < board_height; i++)
+    {
+        color_rows[i] = 0;
+        for (int j = 0; j < board_width && locked_rows[i]; j++)
+        {
+            if (locked_rows[i] & (BoardRow(1) << j))
+            {
+                color_rows[i] |= static_cast<ColorRow>(BSC::GRAY) << (j * bits_per_color);
+            }
+        }
+    }
+    set_positions_to_color(falling_piece.positions, get_piece_color(falling_piece.type));
+    column_heights = compute_column_heights(locked_rows);
+    board_features = compute_board_features(locked_rows);
+}
+
+TetrisGame::LineClear TetrisGame::get_last_line_clear()
+{
+    return last_line_clear;
+}
+
+TetrisGame::LineClearCounts TetrisGame::get_line_clear_counts()
+{
+    return line_clear_counts;
+}
+
 void TetrisGame::initialize_game()
 {
-    add_seven_pieces_to_queue();
+    board_features = compute_board_features(occupied_rows);
     add_next_piece_to_board();
+    hash = compute_hash();
+}
+
+// Replaces the locked squares with a picture of the board, one line of text
+// per row from the top down, with the last line being the bottom row. '.' is
+// an empty square, 'G' is a garbage square and a piece letter is a square of
+// that piece's color.
+// Returns false and leaves the board alone if the picture is malformed.
+bool TetrisGame::set_board(const std::string &picture)
+{
+    std::vector<std::string> lines;
+    size_t line_start = 0;
+    while (line_start < picture.size())
+    {
+        size_t line_end = std::min(picture.find('\n', line_start), picture.size());
+        if (line_end > line_start)
+        {
+            lines.push_back(picture.substr(line_start, line_end - line_start));
+        }
+        line_start = line_end + 1;
+    }
+
+    if (lines.size() > board_height)
+    {
+        return false;
+    }
+
+    const std::string piece_letters = "IJLOSZT";
+    for (const auto &line : lines)
+    {
+        if (line.size() != board_width ||
+            line.find_first_not_of(piece_letters + "G.") != std::string::npos)
+        {
+            return false;
+        }
+    }
+
+    remove_falling_piece_from_board();
+    occupied_rows.fill(0);
+    color_rows.fill(0);
+    for (size_t x = 0; x < lines.size(); x++)
+    {
+        const int i = lines.size() - 1 - x;
+        for (int j = 0; j < board_width; j++)
+        {
+            if (lines[x][j] == 'G')
+            {
+                set_square(i, j, BSC::GRAY);
+            }
+            else if (lines[x][j] != '.')
+            {
+                set_square(i, j, get_piece_color(static_cast<PieceType>(piece_letters.find(lines[x][j]))));
+            }
+        }
+    }
+    column_heights = compute_column_heights(occupied_rows);
+    board_features = compute_board_features(occupied_rows);
+    add_falling_piece_to_board();
+    hash = compute_hash();
+    return true;
+}
+
+// Replaces the falling piece with a new piece of the given type at the top
+// of the board, leaving the upcoming pieces untouched.
+void TetrisGame::set_falling_piece(const PieceType type)
+{
+    remove_falling_piece_from_board();
+    add_piece_to_board(type);
+}
+
+// Moves the falling piece straight to a resting place found by a search and
+// locks it there, without recording an input.
+void TetrisGame::lock_falling_piece_at(const FallingPiece &placement)
+{
+    remove_falling_piece_from_board();
+    falling_piece = placement;
+    add_falling_piece_to_board();
+    lock_falling_piece();
 }
 
 TetrisGame::BoardSquareColor TetrisGame::get_square(const int i, const int j)
 {
-    return board[i][j];
+    if (!(occupied_rows[i] & (BoardRow(1) << j)))
+    {
+        return BSC::EMPTY;
+    }
+    return static_cast<BoardSquareColor>((color_rows[i] >> (j * bits_per_color)) & color_mask);
 }
 
+// The preview is read straight out of the randomizer's ring, with slot 0 being
+// the last piece shown and the next piece to spawn at the end.
 TetrisGame::BoardSquareColor TetrisGame::get_upcoming_square(const int i, const int j, const int k)
 {
-    return upcoming_board[i][j][k];
+    return upcoming_map[static_cast<int>(get_upcoming_piece(num_upcoming_pieces_shown - 1 - i))][j][k];
+}
+
+TetrisGame::PieceType TetrisGame::get_upcoming_piece(const int i)
+{
+    return static_cast<PieceType>(randomizer.peek(i));
 }
 
 void TetrisGame::hold_piece()
 {
+    record_input(Replay::Input::HOLD);
     if (!a_piece_was_held_this_turn)
     {
         a_piece_was_held_this_turn = true;
@@ -58,6 +338,7 @@ void TetrisGame::hold_piece()
         auto prev_piece_type = falling_piece.type;
         if (a_piece_is_held)
         {
+            hash ^= zobrist_keys.held_piece[static_cast<int>(held_piece)];
             add_piece_to_board(held_piece);
         }
         else
@@ -66,247 +347,719 @@ void TetrisGame::hold_piece()
             a_piece_is_held = true;
         }
         held_piece = prev_piece_type;
+        hash ^= zobrist_keys.held_piece[static_cast<int>(held_piece)];
     }
 }
 
-void TetrisGame::update_upcoming_board()
+void TetrisGame::iterate_time()
 {
-    auto queue_copy = upcoming_pieces;
-    for (int i = num_upcoming_pieces_shown - 1; i >= 0; i--)
-    {
-        upcoming_board[i] = upcoming_map.at(queue_copy.front());
-        queue_copy.pop();
-    }
+    record_input(Replay::Input::ITERATE_TIME);
+    advance_time();
 }
 
-void TetrisGame::add_seven_pieces_to_queue()
+void TetrisGame::advance_time()
 {
-    unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-    shuffle(seven_bag.begin(), seven_bag.end(), std::default_random_engine(seed));
-    for (auto piece : seven_bag)
+    bool falling_piece_moved_down = move_falling_piece_if_possible(MovementDirection::DOWN);
+    if (!falling_piece_moved_down)
     {
-        upcoming_pieces.push(piece);
+        lock_falling_piece();
     }
 }
 
-void TetrisGame::iterate_time()
+void TetrisGame::lock_falling_piece()
 {
-    bool falling_piece_moved_down = move_falling_piece_if_possible(MovementDirection::DOWN);
-    if (!falling_piece_moved_down)
+    raise_column_heights(column_heights, falling_piece.positions);
+    add_locked_squares_to_features(board_features, occupied_rows, column_heights, falling_piece.positions);
+    hash ^= zobrist_keys.falling_piece[static_cast<int>(falling_piece.type)];
+    // A board from set_board can start with full lines, which all clear on
+    // the first lock.
+    const int num_lines_cleared = clear_any_full_lines().num_lines_cleared;
+    line_clear_counts[std::min(num_lines_cleared, int(line_clear_counts.size()) - 1)]++;
+    if (lock_observer)
     {
-        clear_any_full_lines();
-        add_next_piece_to_board();
-        a_piece_was_held_this_turn = false;
+        lock_observer->piece_locked(falling_piece.positions, num_lines_cleared, a_piece_was_held_this_turn, score);
     }
-
-    if (upcoming_pieces.size() <= num_upcoming_pieces_shown)
+    add_next_piece_to_board();
+    a_piece_was_held_this_turn = false;
+    if (lock_observer)
     {
-        add_seven_pieces_to_queue();
+        lock_observer->piece_spawned(*this);
     }
 }
 
 bool TetrisGame::move_falling_piece_if_possible(MovementDirection direction)
 {
     remove_falling_piece_from_board();
-    auto positions_to_test = get_moved_positions(direction);
-    bool piece_moved = test_and_set_new_positions_and_state(positions_to_test, falling_piece.rotation_state);
+    bool piece_moved = move_piece_if_possible(occupied_rows, falling_piece, direction);
     add_falling_piece_to_board();
     return piece_moved;
 }
 
-TetrisGame::PiecePositions TetrisGame::get_moved_positions(MovementDirection direction)
+bool TetrisGame::move_piece_if_possible(const OccupancyBoard &locked_rows, FallingPiece &piece, const MovementDirection direction)
 {
-    auto position_mover_function = get_position_mover_function(direction);
-    PiecePositions moved_positions;
-    for (int x = 0; x < falling_piece.positions.size(); x++)
-    {
-        moved_positions[x] = position_mover_function(falling_piece.positions[x]);
-    }
-    return moved_positions;
+    auto positions_to_test = get_moved_positions(piece.positions, direction);
+    return test_and_set_new_positions_and_state(locked_rows, piece, positions_to_test, piece.rotation_state);
+}
+
+TetrisGame::PiecePositions TetrisGame::get_moved_positions(const PiecePositions &positions, MovementDirection direction)
+{
+    const auto [i_offset, j_offset] = movement_offsets[static_cast<int>(direction)];
+    return get_kicked_positions(positions, i_offset, j_offset);
 }
 
 void TetrisGame::remove_falling_piece_from_board()
 {
     set_positions_to_color(falling_piece.positions, BSC::EMPTY);
+    hash ^= zobrist_keys.falling_piece[static_cast<int>(falling_piece.type)];
 }
 
 void TetrisGame::add_falling_piece_to_board()
 {
-    BoardSquareColor piece_color = piece_colors.at(falling_piece.type);
-    set_positions_to_color(falling_piece.positions, piece_color);
+    set_positions_to_color(falling_piece.positions, get_piece_color(falling_piece.type));
+    hash ^= zobrist_keys.falling_piece[static_cast<int>(falling_piece.type)];
 }
 
-void TetrisGame::clear_any_full_lines()
+TetrisGame::LineClear TetrisGame::clear_any_full_lines()
 {
-    std::vector<int> full_lines;
-    for (int i = board_height - 1; i >= 0; i--)
+    LineClear line_clear;
+    int write_row = 0;
+    for (int read_row = 0; read_row < board_height; read_row++)
     {
-        if (line_is_full(i))
+        // Every row from the first cleared one up either goes away or moves
+        // down, so its squares are hashed out here and back in where it lands.
+        if (write_row != read_row || line_is_full(read_row))
+        {
+            hash ^= get_row_hash(read_row, occupied_rows[read_row]);
+        }
+
+        if (line_is_full(read_row))
         {
-            full_lines.push_back(i);
+            line_clear.cleared_rows |= uint32_t(1) << read_row;
+            line_clear.num_lines_cleared++;
+        }
+        else
+        {
+            if (write_row != read_row)
+            {
+                occupied_rows[write_row] = occupied_rows[read_row];
+                color_rows[write_row] = color_rows[read_row];
+                hash ^= get_row_hash(write_row, occupied_rows[write_row]);
+            }
+            write_row++;
         }
     }
 
-    remove_lines(full_lines);
+    for (; write_row < board_height; write_row++)
+    {
+        occupied_rows[write_row] = 0;
+        color_rows[write_row] = 0;
+    }
+
+    remove_cleared_lines_from_features(board_features, column_heights, occupied_rows, line_clear);
 
-    int num_lines_cleared = full_lines.size();
-    add_empty_lines(num_lines_cleared);
-    score += num_lines_cleared;
+    score += line_clear.num_lines_cleared;
+    last_line_clear = line_clear;
+    return line_clear;
 }
 
-bool TetrisGame::line_is_full(int i)
+// Pushes the locked squares up by num_lines and fills the rows below them with
+// garbage, full except for hole_column. The falling piece is pushed up with
+// the stack when it would otherwise overlap it. Squares pushed off the top, or
+// a falling piece with nowhere to go, end the game. A hole_column outside the
+// board adds nothing.
+void TetrisGame::add_garbage_lines(const int num_lines, const int hole_column)
 {
-    for (auto square : board[i])
+    const int num_garbage_lines = std::min(num_lines, int(board_height));
+    if (num_garbage_lines <= 0 || hole_column < 0 || hole_column >= board_width)
+    {
+        return;
+    }
+
+    remove_falling_piece_from_board();
+    bool squares_are_pushed_off = false;
+    for (auto height : column_heights)
     {
-        if (square == BSC::EMPTY)
+        if (height + num_garbage_lines > board_height)
         {
-            return false;
+            squares_are_pushed_off = true;
+            game_is_over = true;
         }
     }
-    return true;
+
+    for (int i = board_height - 1; i >= num_garbage_lines; i--)
+    {
+        occupied_rows[i] = occupied_rows[i - num_garbage_lines];
+        color_rows[i] = color_rows[i - num_garbage_lines];
+    }
+    for (int i = 0; i < num_garbage_lines; i++)
+    {
+        occupied_rows[i] = full_row & ~(BoardRow(1) << hole_column);
+        color_rows[i] = gray_color_row;
+    }
+    if (squares_are_pushed_off)
+    {
+        column_heights = compute_column_heights(occupied_rows);
+        board_features = compute_board_features(occupied_rows);
+    }
+    else
+    {
+        add_garbage_lines_to_features(board_features, column_heights, occupied_rows, num_garbage_lines, hole_column);
+    }
+
+    int offset = 0;
+    while (offset <= num_garbage_lines &&
+           !positions_are_valid(occupied_rows, get_kicked_positions(falling_piece.positions, offset, 0)))
+    {
+        offset++;
+    }
+    if (offset > num_garbage_lines)
+    {
+        game_is_over = true;
+    }
+    else
+    {
+        falling_piece.positions = get_kicked_positions(falling_piece.positions, offset, 0);
+    }
+    add_falling_piece_to_board();
+    hash = compute_hash();
+
+    if (lock_observer)
+    {
+        lock_observer->piece_spawned(*this);
+    }
 }
 
-void TetrisGame::remove_lines(std::vector<int> line_nums)
+TetrisGame::ColumnHeights TetrisGame::compute_column_heights(const OccupancyBoard &rows)
 {
-    for (auto line_num : line_nums)
+    ColumnHeights heights = {};
+    BoardRow columns_left = full_row;
+    for (int i = board_height - 1; i >= 0 && columns_left; i--)
     {
-        for (int i = line_num + 1; i < board_height; i++)
+        const BoardRow found_columns = rows[i] & columns_left;
+        for (int j = 0; j < board_width; j++)
         {
-            for (int j = 0; j < board_width; j++)
+            if (found_columns & (BoardRow(1) << j))
             {
-                board[i - 1][j] = board[i][j];
+                heights[j] = i + 1;
             }
         }
+        columns_left &= ~found_columns;
     }
+    return heights;
 }
 
-void TetrisGame::add_empty_lines(int num_lines)
+void TetrisGame::raise_column_heights(ColumnHeights &heights, const PiecePositions &positions)
 {
-    for (int i = board_height - 1; i >= board_height - num_lines; i--)
+    for (auto [i, j] : positions)
     {
-        board[i] = empty_line;
+        if (heights[j] <= i)
+        {
+            heights[j] = i + 1;
+        }
     }
 }
 
+TetrisGame::BoardFeatures TetrisGame::get_board_features()
+{
+    return board_features;
+}
+
+// The features the board would have if the given squares were locked and any
+// full lines cleared, leaving the game untouched.
+TetrisGame::BoardFeatures TetrisGame::evaluate_placement(const PiecePositions &positions)
+{
+    auto rows = get_locked_rows();
+    for (auto [i, j] : positions)
+    {
+        rows[i] |= BoardRow(1) << j;
+    }
+
+    auto heights = column_heights;
+    raise_column_heights(heights, positions);
+    auto features = board_features;
+    add_locked_squares_to_features(features, rows, heights, positions);
+    remove_cleared_lines_from_features(features, heights, rows, lock_piece(rows, positions));
+    return features;
+}
+
+TetrisGame::BoardFeatures TetrisGame::compute_board_features(const OccupancyBoard &rows)
+{
+    BoardFeatures features;
+    BoardRow row_below = full_row;
+    for (int i = 0; i < board_height; i++)
+    {
+        features.num_locked_squares += count_bits(rows[i]);
+        features.row_transitions += get_row_transitions(rows[i]);
+        features.column_transitions += count_bits(rows[i] ^ row_below);
+        row_below = rows[i];
+    }
+    set_height_features(features, compute_column_heights(rows));
+    return features;
+}
+
+// Updates the features for squares that have just been locked into rows, which
+// must not have had any lines cleared. A piece only spans consecutive rows, so
+// only the transitions in and next to those rows can change.
+void TetrisGame::add_locked_squares_to_features(BoardFeatures &features, const OccupancyBoard &rows, const ColumnHeights &heights, const PiecePositions &positions)
+{
+    int lowest_row = board_height;
+    int highest_row = 0;
+    for (auto [i, j] : positions)
+    {
+        lowest_row = std::min(lowest_row, int(i));
+        highest_row = std::max(highest_row, int(i));
+    }
+
+    // The rows from one below the squares to one above them, before and after
+    // the lock, with the floor as a filled row.
+    const int num_rows = highest_row - lowest_row + 3;
+    std::array<BoardRow, 6> rows_after;
+    for (int x = 0; x < num_rows; x++)
+    {
+        const int i = lowest_row - 1 + x;
+        rows_after[x] = i < 0 ? full_row : (i < board_height ? rows[i] : 0);
+    }
+    auto rows_before = rows_after;
+    for (auto [i, j] : positions)
+    {
+        rows_before[i - lowest_row + 1] &= ~(BoardRow(1) << j);
+    }
+
+    for (int x = 1; x < num_rows - 1; x++)
+    {
+        features.row_transitions += get_row_transitions(rows_after[x]) - get_row_transitions(rows_before[x]);
+    }
+    for (int x = 1; x < num_rows && lowest_row - 1 + x < board_height; x++)
+    {
+        features.column_transitions += count_bits(rows_after[x] ^ rows_after[x - 1]) -
+                                       count_bits(rows_before[x] ^ rows_before[x - 1]);
+    }
+
+    features.num_locked_squares += positions.size();
+    set_height_features(features, heights);
+}
+
+// Updates the features and heights for the lines in line_clear, which have
+// already been removed from rows. The cleared lines were full, so the rows
+// from before the clear follow from the ones after it, and only the column
+// transitions across the seams left by the cleared lines can change.
+void TetrisGame::remove_cleared_lines_from_features(BoardFeatures &features, ColumnHeights &heights, const OccupancyBoard &rows, const LineClear &line_clear)
+{
+    const int num_lines = line_clear.num_lines_cleared;
+    if (num_lines == 0)
+    {
+        return;
+    }
+
+    // The number of cleared lines below row i, counted before the clear.
+    const auto get_num_lines_below = [&](const int i)
+    {
+        return count_bits(line_clear.cleared_rows & ((uint32_t(1) << i) - 1));
+    };
+
+    for (int i = 0; i < board_height; i++)
+    {
+        if (!(line_clear.cleared_rows & (uint32_t(1) << i)))
+        {
+            continue;
+        }
+
+        // The transitions between the cleared line and the row below it,
+        // which are none when that row is the floor or another cleared line.
+        if (i > 0 && !(line_clear.cleared_rows & (uint32_t(1) << (i - 1))))
+        {
+            features.column_transitions -= board_width - count_bits(rows[i - 1 - get_num_lines_below(i - 1)]);
+        }
+
+        // The row above a run of cleared lines lands on the row below the
+        // run, leaving no transitions on a line that was full.
+        if (i + 1 < board_height && !(line_clear.cleared_rows & (uint32_t(1) << (i + 1))))
+        {
+            const int landed_i = i + 1 - get_num_lines_below(i + 1);
+            const BoardRow row_below = landed_i > 0 ? rows[landed_i - 1] : full_row;
+            features.column_transitions += count_bits(rows[landed_i] ^ row_below) - (board_width - count_bits(rows[landed_i]));
+        }
+    }
+    // The empty rows that come in at the top sit on the highest kept row.
+    features.column_transitions += count_bits(num_lines < board_height ? rows[board_height - num_lines - 1] : full_row);
+
+    features.row_transitions += num_lines * (get_row_transitions(0) - get_row_transitions(full_row));
+    features.num_locked_squares -= num_lines * board_width;
+
+    // Each column drops by the lines cleared below its top. A column whose
+    // top was in a cleared line then drops to the next square down.
+    for (int j = 0; j < board_width; j++)
+    {
+        heights[j] -= get_num_lines_below(heights[j]);
+        while (heights[j] > 0 && !(rows[heights[j] - 1] & (BoardRow(1) << j)))
+        {
+            heights[j]--;
+        }
+    }
+    set_height_features(features, heights);
+}
+
+// Updates the features and heights for num_lines garbage lines having been
+// pushed in under the locked squares of rows, when no squares were pushed off
+// the top. Only the empty rows at the top go away, so only the transitions at
+// the bottom of the board and under the top row can change.
+void TetrisGame::add_garbage_lines_to_features(BoardFeatures &features, ColumnHeights &heights, const OccupancyBoard &rows, const int num_lines, const int hole_column)
+{
+    // The bottom of the board before the lines were added, on the floor.
+    const BoardRow old_bottom_row = num_lines < board_height ? rows[num_lines] : 0;
+    features.column_transitions -= count_bits(old_bottom_row ^ full_row);
+    BoardRow row_below = full_row;
+    for (int i = 0; i <= num_lines && i < board_height; i++)
+    {
+        features.column_transitions += count_bits(rows[i] ^ row_below);
+        row_below = rows[i];
+    }
+    // The old top row was empty, which made a transition under every square
+    // of the row that is now at the top.
+    if (num_lines < board_height)
+    {
+        features.column_transitions -= count_bits(rows[board_height - 1]);
+    }
+
+    features.row_transitions += num_lines * (get_row_transitions(rows[0]) - get_row_transitions(0));
+    features.num_locked_squares += num_lines * (board_width - 1);
+
+    for (int j = 0; j < board_width; j++)
+    {
+        if (heights[j] > 0 || j != hole_column)
+        {
+            heights[j] += num_lines;
+        }
+    }
+    set_height_features(features, heights);
+}
+
+// Every square below the top of its column is either locked or a hole, so the
+// holes follow from the heights and the number of locked squares.
+void TetrisGame::set_height_features(BoardFeatures &features, const ColumnHeights &heights)
+{
+    features.aggregate_height = 0;
+    features.bumpiness = 0;
+    features.wells = 0;
+    for (int j = 0; j < board_width; j++)
+    {
+        const int left_height = j > 0 ? heights[j - 1] : board_height;
+        const int right_height = j < board_width - 1 ? heights[j + 1] : board_height;
+        features.aggregate_height += heights[j];
+        features.wells += std::max(0, std::min(left_height, right_height) - heights[j]);
+        if (j > 0)
+        {
+            features.bumpiness += std::abs(heights[j] - heights[j - 1]);
+        }
+    }
+    features.holes = features.aggregate_height - features.num_locked_squares;
+}
+
+uint64_t TetrisGame::get_hash()
+{
+    return hash;
+}
+
+uint64_t TetrisGame::get_row_hash(const int i, const BoardRow row)
+{
+    uint64_t row_hash = 0;
+    for (int j = 0; j < board_width; j++)
+    {
+        if (row & (BoardRow(1) << j))
+        {
+            row_hash ^= zobrist_keys.squares[i][j];
+        }
+    }
+    return row_hash;
+}
+
+// The pieces shown follow from the seed and how many pieces have been dealt,
+// so within one game that count stands in for the whole preview.
+uint64_t TetrisGame::get_preview_position_key()
+{
+    uint64_t state = randomizer.get_num_pieces_dealt();
+    return splitmix64(state);
+}
+
+// Builds the hash from scratch, for when the board is replaced wholesale.
+uint64_t TetrisGame::compute_hash()
+{
+    uint64_t new_hash = get_preview_position_key();
+    for (int i = 0; i < board_height; i++)
+    {
+        new_hash ^= get_row_hash(i, occupied_rows[i]);
+    }
+    new_hash ^= zobrist_keys.falling_piece[static_cast<int>(falling_piece.type)];
+    if (a_piece_is_held)
+    {
+        new_hash ^= zobrist_keys.held_piece[static_cast<int>(held_piece)];
+    }
+    return new_hash;
+}
+
+int TetrisGame::get_row_transitions(const BoardRow row)
+{
+    const uint32_t walled_row = (uint32_t(row) << 1) | 1 | (uint32_t(1) << (board_width + 1));
+    return count_bits((walled_row ^ (walled_row >> 1)) & ((uint32_t(1) << (board_width + 1)) - 1));
+}
+
+TetrisGame::LineClear TetrisGame::lock_piece(OccupancyBoard &locked_rows, const PiecePositions &positions)
+{
+    for (const auto &[i, j] : positions)
+    {
+        locked_rows[i] |= BoardRow(1) << j;
+    }
+
+    LineClear line_clear;
+    int write_row = 0;
+    for (int read_row = 0; read_row < board_height; read_row++)
+    {
+        if (locked_rows[read_row] == full_row)
+        {
+            line_clear.cleared_rows |= uint32_t(1) << read_row;
+            line_clear.num_lines_cleared++;
+        }
+        else
+        {
+            locked_rows[write_row] = locked_rows[read_row];
+            write_row++;
+        }
+    }
+
+    for (; write_row < board_height; write_row++)
+    {
+        locked_rows[write_row] = 0;
+    }
+    return line_clear;
+}
+
+bool TetrisGame::line_is_full(int i)
+{
+    return occupied_rows[i] == full_row;
+}
+
 void TetrisGame::add_next_piece_to_board()
 {
-    PieceType next_piece_type = top_and_pop(upcoming_pieces);
+    hash ^= get_preview_position_key();
+    PieceType next_piece_type = static_cast<PieceType>(randomizer.next());
+    hash ^= get_preview_position_key();
     add_piece_to_board(next_piece_type);
-    update_upcoming_board();
 }
 
 void TetrisGame::add_piece_to_board(PieceType type)
 {
-    BoardSquareColor piece_color = piece_colors.at(type);
-    falling_piece.type = type;
-    falling_piece.rotation_state = RotationState::_0;
-    initialize_falling_piece_positions(type);
-    set_positions_to_color(falling_piece.positions, piece_color);
+    falling_piece = get_spawned_piece(type);
+    if (!positions_are_valid(occupied_rows, falling_piece.positions))
+    {
+        game_is_over = true;
+    }
+    add_falling_piece_to_board();
+}
+
+TetrisGame::FallingPiece TetrisGame::get_spawned_piece(const PieceType type)
+{
+    return {type, falling_piece_initial_positions[static_cast<int>(type)], RotationState::_0};
+}
+
+TetrisGame::FallingPiece TetrisGame::get_falling_piece()
+{
+    return falling_piece;
+}
+
+TetrisGame::OccupancyBoard TetrisGame::get_locked_rows()
+{
+    OccupancyBoard locked_rows = occupied_rows;
+    for (const auto &[i, j] : falling_piece.positions)
+    {
+        locked_rows[i] &= ~(BoardRow(1) << j);
+    }
+    return locked_rows;
+}
+
+TetrisGame::ColumnHeights TetrisGame::get_column_heights()
+{
+    return column_heights;
 }
 
-void TetrisGame::initialize_falling_piece_positions(const PieceType type)
+TetrisGame::PiecePositions TetrisGame::get_ghost_positions()
 {
-    falling_piece.positions = falling_piece_initial_positions.at(type);
+    return get_kicked_positions(falling_piece.positions, -get_drop_distance(), 0);
 }
 
-std::function<TetrisGame::SquarePosition(TetrisGame::SquarePosition)> TetrisGame::get_position_mover_function(MovementDirection direction)
+// How far the falling piece can drop. This comes straight from the column
+// heights unless a square of the piece is tucked under an overhang, in which
+// case the board is searched one row at a time.
+int TetrisGame::get_drop_distance()
 {
-    switch (direction)
+    int distance = board_height;
+    for (auto [i, j] : falling_piece.positions)
     {
-    case MovementDirection::LEFT:
-        return [](SquarePosition position)
-        { return SquarePosition{position.first, position.second - 1}; };
-    case MovementDirection::RIGHT:
-        return [](SquarePosition position)
-        { return SquarePosition{position.first, position.second + 1}; };
-    case MovementDirection::DOWN:
-        return [](SquarePosition position)
-        { return SquarePosition{position.first - 1, position.second}; };
+        if (i < column_heights[j])
+        {
+            const auto locked_rows = get_locked_rows();
+            distance = 0;
+            while (positions_are_valid(locked_rows, get_kicked_positions(falling_piece.positions, -(distance + 1), 0)))
+            {
+                distance++;
+            }
+            return distance;
+        }
+        distance = std::min(distance, i - column_heights[j]);
     }
+    return distance;
+}
+
+TetrisGame::BoardSquareColor TetrisGame::get_piece_color(PieceType type)
+{
+    return piece_colors[static_cast<int>(type)];
 }
 
 void TetrisGame::set_positions_to_color(const PiecePositions positions, const BoardSquareColor color)
 {
     for (const auto [i, j] : positions)
     {
-        board[i][j] = color;
+        const BoardRow previous_row = occupied_rows[i];
+        set_square(i, j, color);
+        if (occupied_rows[i] != previous_row)
+        {
+            hash ^= zobrist_keys.squares[i][j];
+        }
+    }
+}
+
+void TetrisGame::set_square(const int i, const int j, const BoardSquareColor color)
+{
+    const BoardRow square_bit = BoardRow(1) << j;
+    if (color == BSC::EMPTY)
+    {
+        occupied_rows[i] &= ~square_bit;
+    }
+    else
+    {
+        const int shift = j * bits_per_color;
+        color_rows[i] = (color_rows[i] & ~(color_mask << shift)) | (static_cast<ColorRow>(color) << shift);
+        occupied_rows[i] |= square_bit;
+    }
+}
+
+void TetrisGame::apply_input(const Replay::Input input)
+{
+    switch (input)
+    {
+    case Replay::Input::LEFT:
+        handle_left_input();
+        break;
+    case Replay::Input::RIGHT:
+        handle_right_input();
+        break;
+    case Replay::Input::ROTATE_LEFT:
+        rotate_left();
+        break;
+    case Replay::Input::ROTATE_RIGHT:
+        rotate_right();
+        break;
+    case Replay::Input::SOFT_DROP:
+        soft_drop();
+        break;
+    case Replay::Input::HARD_DROP:
+        hard_drop();
+        break;
+    case Replay::Input::HOLD:
+        hold_piece();
+        break;
+    case Replay::Input::ITERATE_TIME:
+        iterate_time();
+        break;
     }
 }
 
 void TetrisGame::handle_left_input()
 {
+    record_input(Replay::Input::LEFT);
     move_falling_piece_if_possible(MovementDirection::LEFT);
 }
 
 void TetrisGame::handle_right_input()
 {
+    record_input(Replay::Input::RIGHT);
     move_falling_piece_if_possible(MovementDirection::RIGHT);
 }
 
 void TetrisGame::soft_drop()
 {
-    iterate_time();
+    record_input(Replay::Input::SOFT_DROP);
+    advance_time();
 }
 
 void TetrisGame::hard_drop()
 {
-    while (move_falling_piece_if_possible(MovementDirection::DOWN))
-    {
-        ;
-    }
-    iterate_time();
+    record_input(Replay::Input::HARD_DROP);
+    const auto ghost_positions = get_ghost_positions();
+    remove_falling_piece_from_board();
+    falling_piece.positions = ghost_positions;
+    add_falling_piece_to_board();
+    lock_falling_piece();
 }
 
 void TetrisGame::rotate_left()
 {
+    record_input(Replay::Input::ROTATE_LEFT);
     rotate_falling_piece(RotationDirection::LEFT);
 }
 
 void TetrisGame::rotate_right()
 {
+    record_input(Replay::Input::ROTATE_RIGHT);
     rotate_falling_piece(RotationDirection::RIGHT);
 }
 
 void TetrisGame::rotate_falling_piece(RotationDirection direction)
 {
-    if (falling_piece.type == PieceType::O)
-    {
-        return;
-    }
-
     remove_falling_piece_from_board();
-    set_falling_piece_positions_to_rotated_values(direction);
+    rotate_piece_if_possible(occupied_rows, falling_piece, direction);
     add_falling_piece_to_board();
 }
 
-void TetrisGame::set_falling_piece_positions_to_rotated_values(RotationDirection direction)
+bool TetrisGame::rotate_piece_if_possible(const OccupancyBoard &locked_rows, FallingPiece &piece, const RotationDirection direction)
 {
-    RotationState current_rotation_state = falling_piece.rotation_state;
-
-    PiecePositions possible_new_positions;
-    RotationState possible_new_rotation_state;
+    if (piece.type == PieceType::O)
+    {
+        return false;
+    }
 
-    get_rotated_positions_and_state(possible_new_positions, possible_new_rotation_state, direction);
+    const auto possible_new_positions = get_rotated_positions(piece, direction);
+    const auto new_rotation_state = get_new_rotation_state(piece.rotation_state, direction);
 
-    auto positions_to_test = possible_new_positions;
-    if (test_and_set_new_positions_and_state(positions_to_test, possible_new_rotation_state))
+    if (test_and_set_new_positions_and_state(locked_rows, piece, possible_new_positions, new_rotation_state))
     {
-        return;
+        return true;
     }
 
-    const auto offsets_map = get_offsets_map_for_piece_type(falling_piece.type);
+    const auto &kick_offsets = get_kick_offsets_for_piece_type(piece.type);
 
-    for (auto [j, i] : offsets_map.at({current_rotation_state, possible_new_rotation_state}))
+    for (auto [j, i] : kick_offsets[static_cast<int>(piece.rotation_state)][static_cast<int>(direction)])
     {
-        positions_to_test = get_kicked_positions(possible_new_positions, i, j);
-        if (test_and_set_new_positions_and_state(positions_to_test, possible_new_rotation_state))
+        auto positions_to_test = get_kicked_positions(possible_new_positions, i, j);
+        if (test_and_set_new_positions_and_state(locked_rows, piece, positions_to_test, new_rotation_state))
         {
-            return;
+            return true;
         }
     }
+    return false;
+}
+
+bool TetrisGame::test_and_set_new_positions_and_state(const OccupancyBoard &locked_rows, FallingPiece &piece, const PiecePositions &positions_to_test, RotationState new_rotation_state)
+{
+    bool valid = positions_are_valid(locked_rows, positions_to_test);
+    if (valid)
+    {
+        piece.positions = positions_to_test;
+        piece.rotation_state = new_rotation_state;
+    }
+    return valid;
 }
 
-TetrisGame::OffsetsMap TetrisGame::get_offsets_map_for_piece_type(PieceType type)
+const TetrisGame::RotationOffsets &TetrisGame::get_kick_offsets_for_piece_type(PieceType type)
 {
     if (type == PieceType::I)
     {
@@ -318,36 +1071,25 @@ TetrisGame::OffsetsMap TetrisGame::get_offsets_map_for_piece_type(PieceType type
     }
 }
 
-bool TetrisGame::test_and_set_new_positions_and_state(PiecePositions positions_to_test, RotationState new_rotation_state)
-{
-    bool valid = positions_are_valid(positions_to_test);
-    if (valid)
-    {
-        falling_piece.positions = positions_to_test;
-        falling_piece.rotation_state = new_rotation_state;
-    }
-    return valid;
-}
-
-TetrisGame::PiecePositions TetrisGame::get_kicked_positions(PiecePositions possible_new_positions, int i, int j)
+TetrisGame::PiecePositions TetrisGame::get_kicked_positions(const PiecePositions &possible_new_positions, int i, int j)
 {
     PiecePositions offset_positions;
     int x = 0;
     for (auto [k, l] : possible_new_positions)
     {
-        offset_positions[x] = {i + k, j + l};
+        offset_positions[x] = {int8_t(i + k), int8_t(j + l)};
         x++;
     }
     return offset_positions;
 }
 
-bool TetrisGame::positions_are_valid(PiecePositions positions)
+bool TetrisGame::positions_are_valid(const OccupancyBoard &locked_rows, const PiecePositions &positions)
 {
     for (auto [i, j] : positions)
     {
         if (i < 0 || i >= board_height ||
             j < 0 || j >= board_width ||
-            board[i][j] != BSC::EMPTY)
+            (locked_rows[i] & (BoardRow(1) << j)))
         {
             return false;
         }
@@ -355,29 +1097,28 @@ bool TetrisGame::positions_are_valid(PiecePositions positions)
     return true;
 };
 
-void TetrisGame::get_rotated_positions_and_state(PiecePositions &new_positions, RotationState &new_state, RotationDirection direction)
+TetrisGame::PiecePositions TetrisGame::get_rotated_positions(const FallingPiece &piece, RotationDirection direction)
 {
-    const auto [i, j] = falling_piece.positions[0];
-
-    new_state = get_new_rotation_state(direction);
-
-    auto rotation_offsets = rotation_offsets_based_on_previous_top_left_square.at(falling_piece.type).at({falling_piece.rotation_state, new_state});
+    const auto [i, j] = piece.positions[0];
+    const auto &rotation_offsets = rotation_offsets_based_on_previous_top_left_square[static_cast<int>(piece.type)][static_cast<int>(piece.rotation_state)][static_cast<int>(direction)];
 
-    for (int x = 0; x < new_positions.size(); x++)
+    PiecePositions new_positions;
+    for (size_t x = 0; x < new_positions.size(); x++)
     {
         const auto [i_offset, j_offset] = rotation_offsets[x];
-        new_positions[x] = {i + i_offset, j + j_offset};
+        new_positions[x] = {int8_t(i + i_offset), int8_t(j + j_offset)};
     }
+    return new_positions;
 }
 
-TetrisGame::RotationState TetrisGame::get_new_rotation_state(RotationDirection direction)
+TetrisGame::RotationState TetrisGame::get_new_rotation_state(RotationState rotation_state, RotationDirection direction)
 {
     if (direction == RotationDirection::LEFT)
     {
-        return static_cast<RotationState>(std::min(static_cast<unsigned int>(falling_piece.rotation_state) - 1, (unsigned)3));
+        return static_cast<RotationState>(std::min(static_cast<unsigned int>(rotation_state) - 1, (unsigned)3));
     }
     else
     {
-        return static_cast<RotationState>((static_cast<int>(falling_piece.rotation_state) + 1) % 4);
+        return static_cast<RotationState>((static_cast<int>(rotation_state) + 1) % 4);
     }
 }
\ No newline at end of file
@@ -1,9 +1,11 @@
 #pragma once
 
-#include <queue>
-#include <unordered_map>
 #include <array>
-#include <functional>
+#include <cstdint>
+#include <string>
+
+#include "PieceRandomizer.h"
+#include "Replay.h"
 
 class TetrisGame
 {
@@ -14,8 +16,9 @@ public:
     static const int upcoming_board_width = 4;
     static const int upcoming_board_lines_per_piece = 3;
     static const int num_upcoming_pieces_shown = 5;
+    static const int num_piece_types = PieceRandomizer::num_piece_types;
 
-    enum class PieceType
+    enum class PieceType : uint8_t
     {
         I,
         J,
@@ -26,7 +29,7 @@ public:
         T
     };
 
-    enum class BoardSquareColor
+    enum class BoardSquareColor : uint8_t
     {
         LIGHT_BLUE,
         DARK_BLUE,
@@ -35,32 +38,34 @@ public:
         GREEN,
         RED,
         MAGENTA,
+        GRAY,
         EMPTY
     };
 
-    TetrisGame();
-    void iterate_time();
-    BoardSquareColor get_square(const int, const int);
-    BoardSquareColor get_upcoming_square(const int, const int, const int);
-    void hard_drop();
-    void soft_drop();
-    void hold_piece();
-    void handle_left_input();
-    void handle_right_input();
-    void rotate_left();
-    void rotate_right();
-    int get_score();
-    PieceType get_held_piece();
-    bool get_whether_a_piece_is_held();
+    // Bit i of cleared_rows is set when row i (numbered before the rows above
+    // it were shifted down) was cleared.
+    struct LineClear
+    {
+        uint32_t cleared_rows = 0;
+        int num_lines_cleared = 0;
+    };
+
+    // How many locked pieces cleared each number of lines, from none up to
+    // four or more.
+    using LineClearCounts = std::array<uint32_t, 5>;
+
+    struct SquarePosition
+    {
+        int8_t i;
+        int8_t j;
+    };
 
-private:
-    using BSC = BoardSquareColor;
-    using SquarePosition = std::pair<int, int>;
     using PiecePositions = std::array<SquarePosition, 4>;
-    using BoardLine = std::array<BoardSquareColor, board_width>;
-    using TetrisBoard = std::array<BoardLine, board_height>;
-    using UpcomingPiece = std::array<std::array<BoardSquareColor, upcoming_board_width>, upcoming_board_lines_per_piece>;
-    using UpcomingBoard = std::array<UpcomingPiece, num_upcoming_pieces_shown>;
+    using BoardRow = uint16_t;
+    using OccupancyBoard = std::array<BoardRow, board_height>;
+    using ColorRow = uint32_t;
+    using ColorBoard = std::array<ColorRow, board_height>;
+    using ColumnHeights = std::array<uint8_t, board_width>;
 
     enum class MovementDirection
     {
@@ -75,7 +80,7 @@ private:
         RIGHT
     };
 
-    enum class RotationState
+    enum class RotationState : uint8_t
     {
         _0,
         _R,
@@ -83,247 +88,354 @@ private:
         _L,
     };
 
-    inline static const std::unordered_map<PieceType, BoardSquareColor> piece_colors = {
-        {PieceType::I, BSC::LIGHT_BLUE},
-        {PieceType::J, BSC::DARK_BLUE},
-        {PieceType::L, BSC::ORANGE},
-        {PieceType::O, BSC::YELLOW},
-        {PieceType::S, BSC::GREEN},
-        {PieceType::Z, BSC::RED},
-        {PieceType::T, BSC::MAGENTA},
-    };
-
     struct FallingPiece
     {
         PieceType type;
         PiecePositions positions;
         RotationState rotation_state;
-    } falling_piece;
+    };
 
-    int score = 0;
-    bool a_piece_is_held = false;
-    bool a_piece_was_held_this_turn = false;
-    PieceType held_piece;
-    std::queue<PieceType> upcoming_pieces;
-    std::array<PieceType, 7> seven_bag = {PieceType::I, PieceType::J, PieceType::L, PieceType::O, PieceType::S, PieceType::Z, PieceType::T};
+    // The usual board evaluation heuristics for the locked squares. Row
+    // transitions count the walls as filled and column transitions count the
+    // floor as filled. Wells is the summed depth of every column lower than
+    // both of its neighbours.
+    struct BoardFeatures
+    {
+        int num_locked_squares = 0;
+        int aggregate_height = 0;
+        int holes = 0;
+        int bumpiness = 0;
+        int wells = 0;
+        int row_transitions = 0;
+        int column_transitions = 0;
+    };
 
-    class RotationStatePairHashFunction
+    // Everything needed to put a game back exactly as it was, as a plain value
+    // that can be copied with memcpy, for searches that branch from a game.
+    struct GameState
     {
-    public:
-        size_t operator()(const std::pair<RotationState, RotationState> &key) const
-        {
-            int first_state_as_int = static_cast<int>(key.first);
-            int second_state_as_int = static_cast<int>(key.second);
-            int hash = first_state_as_int * 4 + second_state_as_int;
-            return size_t(hash);
-        }
+        OccupancyBoard occupied_rows;
+        ColorBoard color_rows;
+        ColumnHeights column_heights;
+        BoardFeatures board_features;
+        FallingPiece falling_piece;
+        PieceRandomizer randomizer;
+        PieceType held_piece;
+        bool a_piece_is_held;
+        bool a_piece_was_held_this_turn;
+        bool game_is_over;
+        int score;
+        LineClear last_line_clear;
+        LineClearCounts line_clear_counts;
+        uint64_t hash;
     };
 
-    inline static const std::unordered_map<PieceType, PiecePositions> falling_piece_initial_positions = {
-        {PieceType::I, {{{board_height - 2, 3}, {board_height - 2, 4}, {board_height - 2, 5}, {board_height - 2, 6}}}},
-        {PieceType::J, {{{board_height - 1, 3}, {board_height - 2, 3}, {board_height - 2, 4}, {board_height - 2, 5}}}},
-        {PieceType::L, {{{board_height - 1, 5}, {board_height - 2, 3}, {board_height - 2, 4}, {board_height - 2, 5}}}},
-        {PieceType::O, {{{board_height - 1, 4}, {board_height - 1, 5}, {board_height - 2, 4}, {board_height - 2, 5}}}},
-        {PieceType::S, {{{board_height - 1, 4}, {board_height - 1, 5}, {board_height - 2, 3}, {board_height - 2, 4}}}},
-        {PieceType::Z, {{{board_height - 1, 3}, {board_height - 1, 4}, {board_height - 2, 4}, {board_height - 2, 5}}}},
-        {PieceType::T, {{{board_height - 1, 4}, {board_height - 2, 3}, {board_height - 2, 4}, {board_height - 2, 5}}}}};
-
-    typedef std::unordered_map<std::pair<RotationState, RotationState>, PiecePositions, RotationStatePairHashFunction> OffsetsMap;
-
-    inline static const std::unordered_map<PieceType, OffsetsMap> rotation_offsets_based_on_previous_top_left_square =
-        {
-            {PieceType::I, {
-                               {{RotationState::_0, RotationState::_R}, {{{1, 2}, {0, 2}, {-1, 2}, {-2, 2}}}},
-                               {{RotationState::_R, RotationState::_0}, {{{-1, -2}, {-1, -1}, {-1, 0}, {-1, 1}}}},
-                               {{RotationState::_R, RotationState::_2}, {{{-2, -2}, {-2, -1}, {-2, 0}, {-2, 1}}}},
-                               {{RotationState::_2, RotationState::_R}, {{{2, 2}, {1, 2}, {0, 2}, {-1, 2}}}},
-                               {{RotationState::_2, RotationState::_L}, {{{2, 1}, {1, 1}, {0, 1}, {-1, 1}}}},
-                               {{RotationState::_L, RotationState::_2}, {{{-2, -1}, {-2, 0}, {-2, 1}, {-2, 2}}}},
-                               {{RotationState::_L, RotationState::_0}, {{{-1, -1}, {-1, 0}, {-1, 1}, {-1, 2}}}},
-                               {{RotationState::_0, RotationState::_L}, {{{1, 1}, {0, 1}, {-1, 1}, {-2, 1}}}},
-                           }},
-            {PieceType::J, {
-                               {{RotationState::_0, RotationState::_R}, {{{0, 1}, {0, 2}, {-1, 1}, {-2, 1}}}},
-                               {{RotationState::_R, RotationState::_0}, {{{0, -1}, {-1, -1}, {-1, 0}, {-1, 1}}}},
-                               {{RotationState::_R, RotationState::_2}, {{{-1, -1}, {-1, 0}, {-1, 1}, {-2, 1}}}},
-                               {{RotationState::_2, RotationState::_R}, {{{1, 1}, {1, 2}, {0, 1}, {-1, 1}}}},
-                               {{RotationState::_2, RotationState::_L}, {{{1, 1}, {0, 1}, {-1, 0}, {-1, 1}}}},
-                               {{RotationState::_L, RotationState::_2}, {{{-1, -1}, {-1, 0}, {-1, 1}, {-2, 1}}}},
-                               {{RotationState::_L, RotationState::_0}, {{{0, -1}, {-1, -1}, {-1, 0}, {-1, 1}}}},
-                               {{RotationState::_0, RotationState::_L}, {{{0, 1}, {-1, 1}, {-2, 0}, {-2, 1}}}},
-                           }},
-            {PieceType::L, {
-                               {{RotationState::_0, RotationState::_R}, {{{0, -1}, {-1, -1}, {-2, -1}, {-2, 0}}}},
-                               {{RotationState::_R, RotationState::_0}, {{{0, 1}, {-1, -1}, {-1, 0}, {-1, 1}}}},
-                               {{RotationState::_R, RotationState::_2}, {{{-1, -1}, {-1, 0}, {-1, 1}, {-2, -1}}}},
-                               {{RotationState::_2, RotationState::_R}, {{{1, 1}, {0, 1}, {-1, 1}, {-1, 2}}}},
-                               {{RotationState::_2, RotationState::_L}, {{{1, 0}, {1, 1}, {0, 1}, {-1, 1}}}},
-                               {{RotationState::_L, RotationState::_2}, {{{-1, 0}, {-1, 1}, {-1, 2}, {-2, 0}}}},
-                               {{RotationState::_L, RotationState::_0}, {{{0, 2}, {-1, 0}, {-1, 1}, {-1, 2}}}},
-                               {{RotationState::_0, RotationState::_L}, {{{0, -2}, {0, -1}, {-1, -1}, {-2, -1}}}},
-                           }},
-            {PieceType::S, {
-                               {{RotationState::_0, RotationState::_R}, {{{0, 0}, {-1, 0}, {-1, 1}, {-2, 1}}}},
-                               {{RotationState::_R, RotationState::_0}, {{{0, 0}, {0, 1}, {-1, -1}, {-1, 0}}}},
-                               {{RotationState::_R, RotationState::_2}, {{{-1, 0}, {-1, 1}, {-2, -1}, {-2, 0}}}},
-                               {{RotationState::_2, RotationState::_R}, {{{1, 0}, {0, 0}, {0, 1}, {-1, 1}}}},
-                               {{RotationState::_2, RotationState::_L}, {{{1, -1}, {0, -1}, {0, 0}, {-1, 0}}}},
-                               {{RotationState::_L, RotationState::_2}, {{{-1, 1}, {-1, 2}, {-2, 0}, {-2, 1}}}},
-                               {{RotationState::_L, RotationState::_0}, {{{0, 1}, {0, 2}, {-1, 0}, {-1, 1}}}},
-                               {{RotationState::_0, RotationState::_L}, {{{0, -1}, {-1, -1}, {-1, 0}, {-2, 0}}}},
-                           }},
-            {PieceType::Z, {
-                               {{RotationState::_0, RotationState::_R}, {{{0, 2}, {-1, 1}, {-1, 2}, {-2, 1}}}},
-                               {{RotationState::_R, RotationState::_0}, {{{0, -2}, {0, -1}, {-1, -1}, {-1, 0}}}},
-                               {{RotationState::_R, RotationState::_2}, {{{-1, -2}, {-1, -1}, {-2, -1}, {-2, 0}}}},
-                               {{RotationState::_2, RotationState::_R}, {{{1, 2}, {0, 1}, {0, 2}, {-1, 1}}}},
-                               {{RotationState::_2, RotationState::_L}, {{{1, 1}, {0, 0}, {0, 1}, {-1, 0}}}},
-                               {{RotationState::_L, RotationState::_2}, {{{-1, -1}, {-1, 0}, {-2, 0}, {-2, 1}}}},
-                               {{RotationState::_L, RotationState::_0}, {{{0, -1}, {0, 0}, {-1, 0}, {-1, 1}}}},
-                               {{RotationState::_0, RotationState::_L}, {{{0, 1}, {-1, 0}, {-1, 1}, {-2, 0}}}},
-                           }},
-            {PieceType::T, {
-                               {{RotationState::_0, RotationState::_R}, {{{0, 0}, {-1, 0}, {-1, 1}, {-2, 0}}}},
-                               {{RotationState::_R, RotationState::_0}, {{{0, 0}, {-1, -1}, {-1, 0}, {-1, 1}}}},
-                               {{RotationState::_R, RotationState::_2}, {{{-1, -1}, {-1, 0}, {-1, 1}, {-2, 0}}}},
-                               {{RotationState::_2, RotationState::_R}, {{{1, 1}, {0, 1}, {0, 2}, {-1, 1}}}},
-                               {{RotationState::_2, RotationState::_L}, {{{1, 1}, {0, 0}, {0, 1}, {-1, 1}}}},
-                               {{RotationState::_L, RotationState::_2}, {{{-1, -1}, {-1, 0}, {-1, 1}, {-2, 0}}}},
-                               {{RotationState::_L, RotationState::_0}, {{{0, 0}, {-1, -1}, {-1, 0}, {-1, 1}}}},
-                               {{RotationState::_0, RotationState::_L}, {{{0, 0}, {-1, -1}, {-1, 0}, {-2, 0}}}},
-                           }},
+    // The part of a game that a search branches on, a third the size of a
+    // GameState so a wide beam can keep one per node. Restoring one needs a
+    // GameState of the position the search started from: the pieces are
+    // dealt again from its randomizer, the column heights and board features
+    // are rebuilt from the board, and the line clear counts are its. Square
+    // colors are not kept, so locked squares come back gray.
+    struct SearchState
+    {
+        uint64_t hash;
+        OccupancyBoard occupied_rows;
+        LineClear last_line_clear;
+        int score;
+        uint32_t num_pieces_dealt;
+        FallingPiece falling_piece;
+        PieceType held_piece;
+        bool a_piece_is_held;
+        bool a_piece_was_held_this_turn;
+        bool game_is_over;
     };
 
-    inline static const OffsetsMap I_kick_offsets =
-        {
-            {{RotationState::_0, RotationState::_R}, {{{-2, 0}, {1, 0}, {-2, -1}, {1, 2}}}},
-            {{RotationState::_R, RotationState::_0}, {{{2, 0}, {-1, 0}, {2, 1}, {-1, -2}}}},
-            {{RotationState::_R, RotationState::_2}, {{{-1, 0}, {2, 0}, {-1, 2}, {2, -1}}}},
-            {{RotationState::_2, RotationState::_R}, {{{1, 0}, {-2, 0}, {1, -2}, {-2, 1}}}},
-            {{RotationState::_2, RotationState::_L}, {{{2, 0}, {-1, 0}, {2, 1}, {-1, -2}}}},
-            {{RotationState::_L, RotationState::_2}, {{{-2, 0}, {1, 0}, {-2, -1}, {1, 2}}}},
-            {{RotationState::_L, RotationState::_0}, {{{1, 0}, {-2, 0}, {1, -2}, {-2, 1}}}},
-            {{RotationState::_0, RotationState::_L}, {{{-1, 0}, {2, 0}, {-1, 2}, {2, -1}}}},
+    // Told about every piece a game locks, so play can be recorded by code
+    // outside the game.
+    class LockObserver
+    {
+    public:
+        virtual ~LockObserver() = default;
+        // A new falling piece has spawned, or garbage lines have changed the
+        // board under the one that is falling.
+        virtual void piece_spawned(TetrisGame &) = 0;
+        // The falling piece has locked at the given positions, clearing that
+        // many lines, and the score is the score after the lock. The bool is
+        // whether hold was used for this piece.
+        virtual void piece_locked(const PiecePositions &, const int, const bool, const int) = 0;
     };
 
-    inline static const OffsetsMap standard_kick_offsets =
-        {
-            {{RotationState::_0, RotationState::_R}, {{{-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}}},
-            {{RotationState::_R, RotationState::_0}, {{{1, 0}, {1, -1}, {0, 2}, {1, 2}}}},
-            {{RotationState::_R, RotationState::_2}, {{{1, 0}, {1, -1}, {0, 2}, {1, 2}}}},
-            {{RotationState::_2, RotationState::_R}, {{{-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}}},
-            {{RotationState::_2, RotationState::_L}, {{{1, 0}, {1, 1}, {0, -2}, {1, -2}}}},
-            {{RotationState::_L, RotationState::_2}, {{{-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}}},
-            {{RotationState::_L, RotationState::_0}, {{{-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}}},
-            {{RotationState::_0, RotationState::_L}, {{{1, 0}, {1, 1}, {0, -2}, {1, -2}}}},
+    TetrisGame();
+    TetrisGame(uint64_t, PieceRandomizer::Policy = PieceRandomizer::Policy::SEVEN_BAG);
+    void iterate_time();
+    BoardSquareColor get_square(const int, const int);
+    BoardSquareColor get_upcoming_square(const int, const int, const int);
+    PieceType get_upcoming_piece(const int);
+    void hard_drop();
+    void soft_drop();
+    void hold_piece();
+    void handle_left_input();
+    void handle_right_input();
+    void rotate_left();
+    void rotate_right();
+    int get_score();
+    PieceType get_held_piece();
+    bool get_whether_a_piece_is_held();
+    bool get_whether_the_game_is_over();
+    LineClear get_last_line_clear();
+    LineClearCounts get_line_clear_counts();
+    uint64_t get_seed();
+    PieceRandomizer::Policy get_policy();
+    void record_inputs_to(Replay *);
+    void set_lock_observer(LockObserver *);
+    bool set_board(const std::string &);
+    void set_falling_piece(const PieceType);
+    void lock_falling_piece_at(const FallingPiece &);
+    void add_garbage_lines(const int, const int);
+    void apply_input(const Replay::Input);
+    FallingPiece get_falling_piece();
+    OccupancyBoard get_locked_rows();
+    ColumnHeights get_column_heights();
+    PiecePositions get_ghost_positions();
+    BoardFeatures get_board_features();
+    uint64_t get_hash();
+    BoardFeatures evaluate_placement(const PiecePositions &);
+    static ColumnHeights compute_column_heights(const OccupancyBoard &);
+    static BoardFeatures compute_board_features(const OccupancyBoard &);
+    GameState snapshot();
+    void restore(const GameState &);
+    SearchState search_snapshot();
+    void restore(const SearchState &, const GameState &);
+
+    // The movement rules, applied to a piece against a board of locked
+    // squares, so searches can explore moves without touching a game.
+    static FallingPiece get_spawned_piece(const PieceType);
+    static bool positions_are_valid(const OccupancyBoard &, const PiecePositions &);
+    static bool move_piece_if_possible(const OccupancyBoard &, FallingPiece &, const MovementDirection);
+    static bool rotate_piece_if_possible(const OccupancyBoard &, FallingPiece &, const RotationDirection);
+    static LineClear lock_piece(OccupancyBoard &, const PiecePositions &);
+
+private:
+    using BSC = BoardSquareColor;
+    using UpcomingPiece = std::array<std::array<BoardSquareColor, upcoming_board_width>, upcoming_board_lines_per_piece>;
+
+    static constexpr std::array<BoardSquareColor, num_piece_types> piece_colors = {
+        BSC::LIGHT_BLUE,
+        BSC::DARK_BLUE,
+        BSC::ORANGE,
+        BSC::YELLOW,
+        BSC::GREEN,
+        BSC::RED,
+        BSC::MAGENTA,
     };
 
-    inline static const BoardLine empty_line = {{BSC::EMPTY, BSC::EMPTY, BSC::EMPTY, BSC::EMPTY, BSC::EMPTY, BSC::EMPTY, BSC::EMPTY, BSC::EMPTY, BSC::EMPTY, BSC::EMPTY}};
-
-    TetrisBoard board = {{
-        empty_line,
-        empty_line,
-        empty_line,
-        empty_line,
-        empty_line,
-        empty_line,
-        empty_line,
-        empty_line,
-        empty_line,
-        empty_line,
-        empty_line,
-        empty_line,
-        empty_line,
-        empty_line,
-        empty_line,
-        empty_line,
-        empty_line,
-        empty_line,
-        empty_line,
-        empty_line,
-        empty_line,
-        empty_line,
+    static constexpr std::array<SquarePosition, 3> movement_offsets = {{
+        {0, -1},
+        {0, 1},
+        {-1, 0},
     }};
 
-    inline static const UpcomingPiece upcoming_I = {{
+    FallingPiece falling_piece;
+    // One past the highest locked square in each column, kept up to date on
+    // lock and line clear so drops don't have to search the board.
+    ColumnHeights column_heights = {};
+    BoardFeatures board_features;
+
+    int score = 0;
+    LineClear last_line_clear;
+    LineClearCounts line_clear_counts = {};
+    // Zobrist hash of the occupied squares, the falling and held pieces and
+    // how far into the piece sequence the preview is, updated as each changes.
+    uint64_t hash = 0;
+    bool a_piece_is_held = false;
+    bool a_piece_was_held_this_turn = false;
+    bool game_is_over = false;
+    PieceType held_piece = PieceType::I;
+    PieceRandomizer randomizer;
+    Replay *replay = nullptr;
+    LockObserver *lock_observer = nullptr;
+
+    static constexpr std::array<PiecePositions, num_piece_types> falling_piece_initial_positions = {{
+        {{{board_height - 2, 3}, {board_height - 2, 4}, {board_height - 2, 5}, {board_height - 2, 6}}},
+        {{{board_height - 1, 3}, {board_height - 2, 3}, {board_height - 2, 4}, {board_height - 2, 5}}},
+        {{{board_height - 1, 5}, {board_height - 2, 3}, {board_height - 2, 4}, {board_height - 2, 5}}},
+        {{{board_height - 1, 4}, {board_height - 1, 5}, {board_height - 2, 4}, {board_height - 2, 5}}},
+        {{{board_height - 1, 4}, {board_height - 1, 5}, {board_height - 2, 3}, {board_height - 2, 4}}},
+        {{{board_height - 1, 3}, {board_height - 1, 4}, {board_height - 2, 4}, {board_height - 2, 5}}},
+        {{{board_height - 1, 4}, {board_height - 2, 3}, {board_height - 2, 4}, {board_height - 2, 5}}},
+    }};
+
+    // Rotation and kick tables are indexed by [RotationState][RotationDirection],
+    // so the entries on each line are the LEFT then RIGHT rotations out of
+    // that state.
+    using RotationOffsets = std::array<std::array<PiecePositions, 2>, 4>;
+
+    static constexpr std::array<RotationOffsets, num_piece_types> rotation_offsets_based_on_previous_top_left_square = {{
+        {{
+            // I
+            {{{{{1, 1}, {0, 1}, {-1, 1}, {-2, 1}}}, {{{1, 2}, {0, 2}, {-1, 2}, {-2, 2}}}}}, // 0->L, 0->R
+            {{{{{-1, -2}, {-1, -1}, {-1, 0}, {-1, 1}}}, {{{-2, -2}, {-2, -1}, {-2, 0}, {-2, 1}}}}}, // R->0, R->2
+            {{{{{2, 2}, {1, 2}, {0, 2}, {-1, 2}}}, {{{2, 1}, {1, 1}, {0, 1}, {-1, 1}}}}}, // 2->R, 2->L
+            {{{{{-2, -1}, {-2, 0}, {-2, 1}, {-2, 2}}}, {{{-1, -1}, {-1, 0}, {-1, 1}, {-1, 2}}}}}, // L->2, L->0
+        }},
+        {{
+            // J
+            {{{{{0, 1}, {-1, 1}, {-2, 0}, {-2, 1}}}, {{{0, 1}, {0, 2}, {-1, 1}, {-2, 1}}}}}, // 0->L, 0->R
+            {{{{{0, -1}, {-1, -1}, {-1, 0}, {-1, 1}}}, {{{-1, -1}, {-1, 0}, {-1, 1}, {-2, 1}}}}}, // R->0, R->2
+            {{{{{1, 1}, {1, 2}, {0, 1}, {-1, 1}}}, {{{1, 1}, {0, 1}, {-1, 0}, {-1, 1}}}}}, // 2->R, 2->L
+            {{{{{-1, -1}, {-1, 0}, {-1, 1}, {-2, 1}}}, {{{0, -1}, {-1, -1}, {-1, 0}, {-1, 1}}}}}, // L->2, L->0
+        }},
+        {{
+            // L
+            {{{{{0, -2}, {0, -1}, {-1, -1}, {-2, -1}}}, {{{0, -1}, {-1, -1}, {-2, -1}, {-2, 0}}}}}, // 0->L, 0->R
+            {{{{{0, 1}, {-1, -1}, {-1, 0}, {-1, 1}}}, {{{-1, -1}, {-1, 0}, {-1, 1}, {-2, -1}}}}}, // R->0, R->2
+            {{{{{1, 1}, {0, 1}, {-1, 1}, {-1, 2}}}, {{{1, 0}, {1, 1}, {0, 1}, {-1, 1}}}}}, // 2->R, 2->L
+            {{{{{-1, 0}, {-1, 1}, {-1, 2}, {-2, 0}}}, {{{0, 2}, {-1, 0}, {-1, 1}, {-1, 2}}}}}, // L->2, L->0
+        }},
+        {{
+            // The O piece never rotates.
+            {{{{{0, 0}, {0, 0}, {0, 0}, {0, 0}}}, {{{0, 0}, {0, 0}, {0, 0}, {0, 0}}}}},
+            {{{{{0, 0}, {0, 0}, {0, 0}, {0, 0}}}, {{{0, 0}, {0, 0}, {0, 0}, {0, 0}}}}},
+            {{{{{0, 0}, {0, 0}, {0, 0}, {0, 0}}}, {{{0, 0}, {0, 0}, {0, 0}, {0, 0}}}}},
+            {{{{{0, 0}, {0, 0}, {0, 0}, {0, 0}}}, {{{0, 0}, {0, 0}, {0, 0}, {0, 0}}}}},
+        }},
+        {{
+            // S
+            {{{{{0, -1}, {-1, -1}, {-1, 0}, {-2, 0}}}, {{{0, 0}, {-1, 0}, {-1, 1}, {-2, 1}}}}}, // 0->L, 0->R
+            {{{{{0, 0}, {0, 1}, {-1, -1}, {-1, 0}}}, {{{-1, 0}, {-1, 1}, {-2, -1}, {-2, 0}}}}}, // R->0, R->2
+            {{{{{1, 0}, {0, 0}, {0, 1}, {-1, 1}}}, {{{1, -1}, {0, -1}, {0, 0}, {-1, 0}}}}}, // 2->R, 2->L
+            {{{{{-1, 1}, {-1, 2}, {-2, 0}, {-2, 1}}}, {{{0, 1}, {0, 2}, {-1, 0}, {-1, 1}}}}}, // L->2, L->0
+        }},
+        {{
+            // Z
+            {{{{{0, 1}, {-1, 0}, {-1, 1}, {-2, 0}}}, {{{0, 2}, {-1, 1}, {-1, 2}, {-2, 1}}}}}, // 0->L, 0->R
+            {{{{{0, -2}, {0, -1}, {-1, -1}, {-1, 0}}}, {{{-1, -2}, {-1, -1}, {-2, -1}, {-2, 0}}}}}, // R->0, R->2
+            {{{{{1, 2}, {0, 1}, {0, 2}, {-1, 1}}}, {{{1, 1}, {0, 0}, {0, 1}, {-1, 0}}}}}, // 2->R, 2->L
+            {{{{{-1, -1}, {-1, 0}, {-2, 0}, {-2, 1}}}, {{{0, -1}, {0, 0}, {-1, 0}, {-1, 1}}}}}, // L->2, L->0
+        }},
+        {{
+            // T
+            {{{{{0, 0}, {-1, -1}, {-1, 0}, {-2, 0}}}, {{{0, 0}, {-1, 0}, {-1, 1}, {-2, 0}}}}}, // 0->L, 0->R
+            {{{{{0, 0}, {-1, -1}, {-1, 0}, {-1, 1}}}, {{{-1, -1}, {-1, 0}, {-1, 1}, {-2, 0}}}}}, // R->0, R->2
+            {{{{{1, 1}, {0, 1}, {0, 2}, {-1, 1}}}, {{{1, 1}, {0, 0}, {0, 1}, {-1, 1}}}}}, // 2->R, 2->L
+            {{{{{-1, -1}, {-1, 0}, {-1, 1}, {-2, 0}}}, {{{0, 0}, {-1, -1}, {-1, 0}, {-1, 1}}}}}, // L->2, L->0
+        }},
+    }};
+
+    static constexpr RotationOffsets I_kick_offsets = {{
+        {{{{{-1, 0}, {2, 0}, {-1, 2}, {2, -1}}}, {{{-2, 0}, {1, 0}, {-2, -1}, {1, 2}}}}}, // 0->L, 0->R
+        {{{{{2, 0}, {-1, 0}, {2, 1}, {-1, -2}}}, {{{-1, 0}, {2, 0}, {-1, 2}, {2, -1}}}}}, // R->0, R->2
+        {{{{{1, 0}, {-2, 0}, {1, -2}, {-2, 1}}}, {{{2, 0}, {-1, 0}, {2, 1}, {-1, -2}}}}}, // 2->R, 2->L
+        {{{{{-2, 0}, {1, 0}, {-2, -1}, {1, 2}}}, {{{1, 0}, {-2, 0}, {1, -2}, {-2, 1}}}}}, // L->2, L->0
+    }};
+
+    static constexpr RotationOffsets standard_kick_offsets = {{
+        {{{{{1, 0}, {1, 1}, {0, -2}, {1, -2}}}, {{{-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}}}}, // 0->L, 0->R
+        {{{{{1, 0}, {1, -1}, {0, 2}, {1, 2}}}, {{{1, 0}, {1, -1}, {0, 2}, {1, 2}}}}}, // R->0, R->2
+        {{{{{-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}}, {{{1, 0}, {1, 1}, {0, -2}, {1, -2}}}}}, // 2->R, 2->L
+        {{{{{-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}}, {{{-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}}}}, // L->2, L->0
+    }};
+
+    // The board is stored as two planes. The occupancy plane holds one bit per
+    // square (bit j of row i is column j), so collision and full line checks
+    // are single mask operations. The color plane packs a 3-bit
+    // BoardSquareColor per square into one word per row and is only read for
+    // rendering. EMPTY doesn't fit in 3 bits, so the color bits of a square
+    // only mean something while its occupancy bit is set.
+    static const int bits_per_color = 3;
+    static const BoardRow full_row = (1 << board_width) - 1;
+    static const ColorRow color_mask = (1 << bits_per_color) - 1;
+    static const ColorRow gray_color_row = (ColorRow(1) << (board_width * bits_per_color)) - 1;
+
+    static_assert(static_cast<ColorRow>(BoardSquareColor::GRAY) == color_mask, "a gray color row must have every color bit set");
+    static_assert(board_width <= 16, "a board row must fit in a BoardRow");
+    static_assert(board_height <= 32, "LineClear::cleared_rows must have a bit per row");
+    static_assert(num_upcoming_pieces_shown <= PieceRandomizer::min_lookahead, "the preview is read from the randomizer's lookahead");
+
+    OccupancyBoard occupied_rows = {};
+    ColorBoard color_rows = {};
+
+    static constexpr UpcomingPiece upcoming_I = {{
         {{BSC::EMPTY, BSC::EMPTY, BSC::EMPTY, BSC::EMPTY}},
-        {{piece_colors.at(PieceType::I), piece_colors.at(PieceType::I), piece_colors.at(PieceType::I), piece_colors.at(PieceType::I)}},
+        {{BSC::LIGHT_BLUE, BSC::LIGHT_BLUE, BSC::LIGHT_BLUE, BSC::LIGHT_BLUE}},
         {{BSC::EMPTY, BSC::EMPTY, BSC::EMPTY, BSC::EMPTY}},
     }};
 
-    inline static const UpcomingPiece upcoming_O = {{
+    static constexpr UpcomingPiece upcoming_O = {{
         {{BSC::EMPTY, BSC::EMPTY, BSC::EMPTY, BSC::EMPTY}},
-        {{BSC::EMPTY, piece_colors.at(PieceType::O), piece_colors.at(PieceType::O), BSC::EMPTY}},
-        {{BSC::EMPTY, piece_colors.at(PieceType::O), piece_colors.at(PieceType::O), BSC::EMPTY}},
+        {{BSC::EMPTY, BSC::YELLOW, BSC::YELLOW, BSC::EMPTY}},
+        {{BSC::EMPTY, BSC::YELLOW, BSC::YELLOW, BSC::EMPTY}},
     }};
 
-    inline static const UpcomingPiece upcoming_J = {{
+    static constexpr UpcomingPiece upcoming_J = {{
         {{BSC::EMPTY, BSC::EMPTY, BSC::EMPTY, BSC::EMPTY}},
-        {{piece_colors.at(PieceType::J), piece_colors.at(PieceType::J), piece_colors.at(PieceType::J), BSC::EMPTY}},
-        {{piece_colors.at(PieceType::J), BSC::EMPTY, BSC::EMPTY, BSC::EMPTY}},
+        {{BSC::DARK_BLUE, BSC::DARK_BLUE, BSC::DARK_BLUE, BSC::EMPTY}},
+        {{BSC::DARK_BLUE, BSC::EMPTY, BSC::EMPTY, BSC::EMPTY}},
     }};
 
-    inline static const UpcomingPiece upcoming_L = {{
+    static constexpr UpcomingPiece upcoming_L = {{
         {{BSC::EMPTY, BSC::EMPTY, BSC::EMPTY, BSC::EMPTY}},
-        {{piece_colors.at(PieceType::L), piece_colors.at(PieceType::L), piece_colors.at(PieceType::L), BSC::EMPTY}},
-        {{BSC::EMPTY, BSC::EMPTY, piece_colors.at(PieceType::L), BSC::EMPTY}},
+        {{BSC::ORANGE, BSC::ORANGE, BSC::ORANGE, BSC::EMPTY}},
+        {{BSC::EMPTY, BSC::EMPTY, BSC::ORANGE, BSC::EMPTY}},
     }};
 
-    inline static const UpcomingPiece upcoming_S = {{
+    static constexpr UpcomingPiece upcoming_S = {{
         {{BSC::EMPTY, BSC::EMPTY, BSC::EMPTY, BSC::EMPTY}},
-        {{piece_colors.at(PieceType::S), piece_colors.at(PieceType::S), BSC::EMPTY, BSC::EMPTY}},
-        {{BSC::EMPTY, piece_colors.at(PieceType::S), piece_colors.at(PieceType::S), BSC::EMPTY}},
+        {{BSC::GREEN, BSC::GREEN, BSC::EMPTY, BSC::EMPTY}},
+        {{BSC::EMPTY, BSC::GREEN, BSC::GREEN, BSC::EMPTY}},
     }};
 
-    inline static const UpcomingPiece upcoming_Z = {{
+    static constexpr UpcomingPiece upcoming_Z = {{
         {{BSC::EMPTY, BSC::EMPTY, BSC::EMPTY, BSC::EMPTY}},
-        {{BSC::EMPTY, piece_colors.at(PieceType::Z), piece_colors.at(PieceType::Z), BSC::EMPTY}},
-        {{piece_colors.at(PieceType::Z), piece_colors.at(PieceType::Z), BSC::EMPTY, BSC::EMPTY}},
+        {{BSC::EMPTY, BSC::RED, BSC::RED, BSC::EMPTY}},
+        {{BSC::RED, BSC::RED, BSC::EMPTY, BSC::EMPTY}},
     }};
 
-    inline static const UpcomingPiece upcoming_T = {{
+    static constexpr UpcomingPiece upcoming_T = {{
         {{BSC::EMPTY, BSC::EMPTY, BSC::EMPTY, BSC::EMPTY}},
-        {{piece_colors.at(PieceType::T), piece_colors.at(PieceType::T), piece_colors.at(PieceType::T), BSC::EMPTY}},
-        {{BSC::EMPTY, piece_colors.at(PieceType::T), BSC::EMPTY, BSC::EMPTY}},
+        {{BSC::MAGENTA, BSC::MAGENTA, BSC::MAGENTA, BSC::EMPTY}},
+        {{BSC::EMPTY, BSC::MAGENTA, BSC::EMPTY, BSC::EMPTY}},
     }};
 
-    inline static const std::unordered_map<PieceType, UpcomingPiece> upcoming_map = {
-        {PieceType::I, upcoming_I},
-        {PieceType::O, upcoming_O},
-        {PieceType::J, upcoming_J},
-        {PieceType::L, upcoming_L},
-        {PieceType::S, upcoming_S},
-        {PieceType::Z, upcoming_Z},
-        {PieceType::T, upcoming_T},
+    static constexpr std::array<UpcomingPiece, num_piece_types> upcoming_map = {
+        upcoming_I,
+        upcoming_J,
+        upcoming_L,
+        upcoming_O,
+        upcoming_S,
+        upcoming_Z,
+        upcoming_T,
     };
 
-    UpcomingBoard upcoming_board;
-
     void initialize_game();
-    void update_upcoming_board();
-    void add_seven_pieces_to_queue();
-    std::function<bool(const int, const int)> get_movement_checker_function(const MovementDirection);
+    void record_input(const Replay::Input);
+    void advance_time();
+    void lock_falling_piece();
+    static void raise_column_heights(ColumnHeights &, const PiecePositions &);
+    static void add_locked_squares_to_features(BoardFeatures &, const OccupancyBoard &, const ColumnHeights &, const PiecePositions &);
+    static void remove_cleared_lines_from_features(BoardFeatures &, ColumnHeights &, const OccupancyBoard &, const LineClear &);
+    static void add_garbage_lines_to_features(BoardFeatures &, ColumnHeights &, const OccupancyBoard &, const int, const int);
+    static void set_height_features(BoardFeatures &, const ColumnHeights &);
+    static int get_row_transitions(const BoardRow);
+    static uint64_t get_row_hash(const int, const BoardRow);
+    uint64_t get_preview_position_key();
+    uint64_t compute_hash();
+    int get_drop_distance();
     void remove_falling_piece_from_board();
     void add_falling_piece_to_board();
-    void clear_any_full_lines();
+    LineClear clear_any_full_lines();
     bool line_is_full(int);
-    void remove_lines(std::vector<int>);
-    void add_empty_lines(int);
     void add_next_piece_to_board();
     void add_piece_to_board(PieceType);
-    void initialize_falling_piece_positions(const PieceType);
     bool move_falling_piece_if_possible(MovementDirection);
-    PiecePositions get_moved_positions(MovementDirection);
-    std::function<SquarePosition(SquarePosition)> get_position_mover_function(MovementDirection);
     void set_positions_to_color(const PiecePositions, const BoardSquareColor);
-    void set_falling_piece_positions_to_one_lower();
-    void get_rotated_positions_and_state(PiecePositions &, RotationState &, RotationDirection);
-    RotationState get_new_rotation_state(RotationDirection);
+    void set_square(const int, const int, const BoardSquareColor);
     void rotate_falling_piece(RotationDirection);
-    void set_falling_piece_positions_to_rotated_values(RotationDirection);
-    PiecePositions get_kicked_positions(PiecePositions, int, int);
-    bool test_and_set_new_positions_and_state(PiecePositions, RotationState);
-    bool test_and_set_new_positions(PiecePositions);
-    bool positions_are_valid(PiecePositions);
-    OffsetsMap get_offsets_map_for_piece_type(PieceType);
+    static PiecePositions get_moved_positions(const PiecePositions &, MovementDirection);
+    static PiecePositions get_rotated_positions(const FallingPiece &, RotationDirection);
+    static RotationState get_new_rotation_state(RotationState, RotationDirection);
+    static PiecePositions get_kicked_positions(const PiecePositions &, int, int);
+    static bool test_and_set_new_positions_and_state(const OccupancyBoard &, FallingPiece &, const PiecePositions &, RotationState);
+    static const RotationOffsets &get_kick_offsets_for_piece_type(PieceType);
+    static BoardSquareColor get_piece_color(PieceType);
 };
\ No newline at end of file
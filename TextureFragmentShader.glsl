@@ -6,13 +6,16 @@ in vec3 normal_cameraspace;
 in vec3 eyeDirection_cameraspace;
 in vec3 lightDirection_cameraspace;
 in vec3 lightPosition_cameraspace;
+flat in int color_index;
+flat in int use_color_texture;
 
 // Ouput data
 out vec3 color;
 
 // Values that stay constant for the whole mesh.
 uniform sampler2D textureSampler;
-uniform int piece_type;
+// One texture per BoardSquareColor except gray, for the preview's cubes.
+uniform sampler2D color_textures[7];
 uniform float ambient_component;
 uniform float diffuse_component;
 uniform int specular_exponent;
@@ -34,24 +37,49 @@ vec3 draw_with_lighting(vec3 base_color) {
 	return ambient + diffuse + specular;
 }
 
+// Sampler arrays can only be indexed by constants, so the texture is picked
+// by branching on the cube's color. The branch differs between cubes, so the
+// UV derivatives are taken before it.
+vec3 sample_color_texture(vec2 dUVdx, vec2 dUVdy) {
+	if (color_index == 0) {
+		return textureGrad(color_textures[0], UV, dUVdx, dUVdy).rgb;
+	} else if (color_index == 1) {
+		return textureGrad(color_textures[1], UV, dUVdx, dUVdy).rgb;
+	} else if (color_index == 2) {
+		return textureGrad(color_textures[2], UV, dUVdx, dUVdy).rgb;
+	} else if (color_index == 3) {
+		return textureGrad(color_textures[3], UV, dUVdx, dUVdy).rgb;
+	} else if (color_index == 4) {
+		return textureGrad(color_textures[4], UV, dUVdx, dUVdy).rgb;
+	} else if (color_index == 5) {
+		return textureGrad(color_textures[5], UV, dUVdx, dUVdy).rgb;
+	} else {
+		return textureGrad(color_textures[6], UV, dUVdx, dUVdy).rgb;
+	}
+}
+
 void main(){
 	vec3 base_color;
 
 	if (use_lighting) {
-		if (piece_type == -1) {
-			base_color = texture(textureSampler, UV).rgb;
-		} else if (piece_type == 0) {
+		vec2 dUVdx = dFdx(UV);
+		vec2 dUVdy = dFdy(UV);
+		if (use_color_texture != 0) {
+			base_color = sample_color_texture(dUVdx, dUVdy);
+		} else if (color_index == 0) {
 			base_color = vec3(0.1f, 1.0f, 1.0f);
-		} else if (piece_type == 1) {
+		} else if (color_index == 1) {
 			base_color = vec3(0.0f, 0.12f, 0.7f);
-		} else if (piece_type == 2) {
+		} else if (color_index == 2) {
 			base_color = vec3(1.0f, 0.5f, 0.0f);
-		} else if (piece_type == 3) {
+		} else if (color_index == 3) {
 			base_color = vec3(1.0f, 0.9f, 0.0f);
-		} else if (piece_type == 4) {
+		} else if (color_index == 4) {
 			base_color = vec3(0.3f, 0.9f, 0.0f);
-		} else if (piece_type == 5) {
+		} else if (color_index == 5) {
 			base_color = vec3(1.0f, 0.0f, 0.0f);
+		} else if (color_index == 7) {
+			base_color = vec3(0.5f, 0.5f, 0.5f);
 		} else {
 			base_color = vec3(0.6f, 0.0f, 0.6f);
 		}
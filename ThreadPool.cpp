@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <cstdint>
+
+#include "ThreadPool.h"
+
+// A thread count of zero or less uses every hardware thread.
+ThreadPool::ThreadPool(const int requested_threads) : tasks_left(0)
+{
+    num_threads = requested_threads > 0 ? requested_threads : std::max(1u, std::thread::hardware_concurrency());
+    task_ranges.reset(new TaskRange[num_threads]);
+    for (int worker = 1; worker < num_threads; worker++)
+    {
+        threads.emplace_back(&ThreadPool::worker_loop, this, worker);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    start_condition.notify_all();
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+int ThreadPool::get_num_threads()
+{
+    return num_threads;
+}
+
+// Calls new_task(task_index, worker_index) for every task index below
+// num_tasks and returns once all of them have finished. The worker index is
+// below get_num_threads(), so tasks can use it to pick per-thread scratch.
+void ThreadPool::run(const int num_tasks, const std::function<void(int, int)> &new_task)
+{
+    if (num_tasks <= 0)
+    {
+        return;
+    }
+
+    // A worker that slept through the last batch can still wake up and join
+    // it after it ended, finding nothing to do. The batch is only set up once
+    // no worker is inside work(), and it is published in the same critical
+    // section, so a worker can't enter work() until every range is set.
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done_condition.wait(lock, [&]()
+                            { return num_working == 0; });
+        task = &new_task;
+        tasks_left = num_tasks;
+        for (int worker = 0; worker < num_threads; worker++)
+        {
+            std::lock_guard<std::mutex> range_lock(task_ranges[worker].mutex);
+            task_ranges[worker].begin = int64_t(num_tasks) * worker / num_threads;
+            task_ranges[worker].end = int64_t(num_tasks) * (worker + 1) / num_threads;
+        }
+        batch++;
+    }
+    start_condition.notify_all();
+
+    work(0);
+
+    // A worker that found its own range empty may still be looking for a
+    // range to steal from. Letting it into the next batch could have it
+    // overwrite the range it is given there, so the batch only ends once
+    // every worker is out.
+    std::unique_lock<std::mutex> lock(mutex);
+    done_condition.wait(lock, [&]()
+                        { return tasks_left == 0 && num_working == 0; });
+}
+
+void ThreadPool::worker_loop(const int worker)
+{
+    uint64_t last_batch = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_condition.wait(lock, [&]()
+                                 { return stopping || batch != last_batch; });
+            if (stopping)
+            {
+                return;
+            }
+            last_batch = batch;
+            num_working++;
+        }
+        work(worker);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            num_working--;
+        }
+        done_condition.notify_all();
+    }
+}
+
+void ThreadPool::work(const int worker)
+{
+    int task_index;
+    while (take_task(worker, task_index) || steal_task(worker, task_index))
+    {
+        (*task)(task_index, worker);
+        if (tasks_left.fetch_sub(1) == 1)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done_condition.notify_all();
+        }
+    }
+}
+
+bool ThreadPool::take_task(const int worker, int &task_index)
+{
+    TaskRange &range = task_ranges[worker];
+    std::lock_guard<std::mutex> lock(range.mutex);
+    if (range.begin == range.end)
+    {
+        return false;
+    }
+    task_index = range.begin++;
+    return true;
+}
+
+// Takes the back half of the first other worker's range that has any tasks
+// left, keeps the first of them to run now and queues the rest as its own.
+bool ThreadPool::steal_task(const int worker, int &task_index)
+{
+    for (int offset = 1; offset < num_threads; offset++)
+    {
+        TaskRange &victim = task_ranges[(worker + offset) % num_threads];
+        int stolen_begin;
+        int stolen_end;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.begin == victim.end)
+            {
+                continue;
+            }
+            stolen_end = victim.end;
+            stolen_begin = victim.begin + (victim.end - victim.begin) / 2;
+            victim.end = stolen_begin;
+        }
+
+        TaskRange &own = task_ranges[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        task_index = stolen_begin;
+        own.begin = stolen_begin + 1;
+        own.end = stolen_end;
+        return true;
+    }
+    return false;
+}
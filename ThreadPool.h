@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that run batches of indexed tasks. Each batch
+// is split evenly between the workers up front; a worker that runs out takes
+// half of the remaining tasks of another worker, so uneven tasks still keep
+// every core busy. The calling thread works as worker 0 while it waits.
+class ThreadPool
+{
+public:
+    ThreadPool(const int);
+    ~ThreadPool();
+    int get_num_threads();
+    void run(const int, const std::function<void(int, int)> &);
+
+private:
+    // Tasks [begin, end) not yet started by this worker or stolen from it.
+    struct alignas(64) TaskRange
+    {
+        std::mutex mutex;
+        int begin = 0;
+        int end = 0;
+    };
+
+    int num_threads;
+    std::vector<std::thread> threads;
+    std::unique_ptr<TaskRange[]> task_ranges;
+
+    std::mutex mutex;
+    std::condition_variable start_condition;
+    std::condition_variable done_condition;
+    uint64_t batch = 0;
+    bool stopping = false;
+    // Workers other than the caller that are inside work().
+    int num_working = 0;
+    const std::function<void(int, int)> *task = nullptr;
+    std::atomic<int> tasks_left;
+
+    void worker_loop(const int);
+    void work(const int);
+    bool take_task(const int, int &);
+    bool steal_task(const int, int &);
+};
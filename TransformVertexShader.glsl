@@ -5,21 +5,29 @@ layout(location = 0) in vec3 vertexPosition_modelspace;
 layout(location = 1) in vec2 vertexUV;
 layout(location = 2) in vec3 normal_modelspace;
 
+// Per-instance data for the cubes, which are the only lit meshes: where the
+// cube is, and its color with whether to texture it.
+layout(location = 3) in vec3 cube_offset;
+layout(location = 4) in ivec2 cube_color;
+
 // Output data ; will be interpolated for each fragment.
 out vec2 UV;
 out vec3 normal_cameraspace;
 out vec3 eyeDirection_cameraspace;
 out vec3 lightDirection_cameraspace;
 out vec3 lightPosition_cameraspace;
+flat out int color_index;
+flat out int use_color_texture;
 
 // Values that stay constant for the whole mesh.
 uniform vec3 lightPosition_worldspace;
 uniform bool use_lighting;
 uniform bool use_mvp;
-uniform mat4 MVP;
 uniform mat4 M;
 uniform mat4 V;
 uniform mat4 P;
+// Shifts the texture, to pick a scoreboard digit out of the digit texture.
+uniform vec2 uv_offset;
 
 uniform vec3 billboard_center;
 uniform vec2 billboard_size;
@@ -31,13 +39,17 @@ void main(){
 	// Output position of the vertex, in clip space : MVP * position
 	
 	// UV of the vertex. No special space for this one.
-	UV = vertexUV;
+	UV = vertexUV + uv_offset;
+	color_index = cube_color.x;
+	use_color_texture = cube_color.y;
 
 	if (use_lighting) {
-		gl_Position =  MVP * vec4(vertexPosition_modelspace,1);
+		mat4 cube_M = mat4(1);
+		cube_M[3] = vec4(cube_offset, 1);
+		gl_Position =  P * V * cube_M * vec4(vertexPosition_modelspace,1);
 		
-		vec3 vertexPosition_cameraspace = (V * M * vec4(vertexPosition_modelspace,1)).xyz;
-		normal_cameraspace = (V * M * vec4(normal_modelspace,1)).xyz;
+		vec3 vertexPosition_cameraspace = (V * cube_M * vec4(vertexPosition_modelspace,1)).xyz;
+		normal_cameraspace = (V * cube_M * vec4(normal_modelspace,1)).xyz;
 		eyeDirection_cameraspace = vec3(0) - vertexPosition_cameraspace;
 		lightPosition_cameraspace = (V * vec4(lightPosition_worldspace,1)).xyz;
 		lightDirection_cameraspace = vertexPosition_cameraspace - lightPosition_cameraspace;
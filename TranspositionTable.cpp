@@ -0,0 +1,73 @@
+#include <cstring>
+
+#include "TranspositionTable.h"
+
+// The table holds 2^log2_num_slots results and never grows.
+TranspositionTable::TranspositionTable(const int log2_num_slots) : slots(new Slot[uint64_t(1) << log2_num_slots]),
+                                                                    num_slots(uint64_t(1) << log2_num_slots)
+{
+    clear();
+}
+
+uint64_t TranspositionTable::get_num_slots()
+{
+    return num_slots;
+}
+
+void TranspositionTable::clear()
+{
+    for (uint64_t x = 0; x < num_slots; x++)
+    {
+        slots[x].checked_key.store(0, std::memory_order_relaxed);
+        slots[x].data.store(0, std::memory_order_relaxed);
+    }
+}
+
+bool TranspositionTable::probe(const uint64_t state_key, Result &result)
+{
+    const uint64_t key = get_table_key(state_key);
+    const Slot &slot = slots[key & (num_slots - 1)];
+    const uint64_t data = slot.data.load(std::memory_order_relaxed);
+    const uint64_t checked_key = slot.checked_key.load(std::memory_order_relaxed);
+    if ((checked_key ^ data) != key)
+    {
+        return false;
+    }
+    result = unpack(data);
+    return true;
+}
+
+// A result for the same state is only replaced by one searched at least as
+// deep. A different state always takes the slot.
+void TranspositionTable::store(const uint64_t state_key, const Result &result)
+{
+    const uint64_t key = get_table_key(state_key);
+    Slot &slot = slots[key & (num_slots - 1)];
+    Result stored;
+    if (probe(state_key, stored) && stored.depth > result.depth)
+    {
+        return;
+    }
+    const uint64_t data = pack(result);
+    slot.data.store(data, std::memory_order_relaxed);
+    slot.checked_key.store(key ^ data, std::memory_order_relaxed);
+}
+
+uint64_t TranspositionTable::get_table_key(const uint64_t state_key)
+{
+    return state_key ? state_key : zero_key_substitute;
+}
+
+uint64_t TranspositionTable::pack(const Result &result)
+{
+    uint64_t data;
+    std::memcpy(&data, &result, sizeof(data));
+    return data;
+}
+
+TranspositionTable::Result TranspositionTable::unpack(const uint64_t data)
+{
+    Result result;
+    std::memcpy(&result, &data, sizeof(result));
+    return result;
+}
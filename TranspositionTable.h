@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// A fixed-size table of search results keyed by TetrisGame::get_hash(), so a
+// search can skip states it has already reached by another move order. Any
+// number of threads can probe and store at once without locking: a result is
+// stored next to its key xor'd with it, so a slot torn by two concurrent
+// stores fails the check on probe rather than returning another state's
+// result.
+class TranspositionTable
+{
+public:
+    struct Result
+    {
+        int32_t value;
+        uint16_t depth;
+        uint16_t best_placement;
+    };
+
+    TranspositionTable(const int);
+    bool probe(const uint64_t, Result &);
+    void store(const uint64_t, const Result &);
+    void clear();
+    uint64_t get_num_slots();
+
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t> checked_key;
+        std::atomic<uint64_t> data;
+    };
+
+    static_assert(sizeof(Result) == sizeof(uint64_t), "a Result must pack into one word");
+
+    // An empty slot reads as key 0 with an all-zero result, so key 0 is
+    // looked up as this key instead. A real key equal to it collides with key
+    // 0, as likely as any other hash collision.
+    static constexpr uint64_t zero_key_substitute = 0x9E3779B97F4A7C15ULL;
+
+    std::unique_ptr<Slot[]> slots;
+    uint64_t num_slots;
+
+    static uint64_t get_table_key(const uint64_t);
+    static uint64_t pack(const Result &);
+    static Result unpack(const uint64_t);
+};
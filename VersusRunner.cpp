@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <chrono>
+
+#include "VersusRunner.h"
+
+namespace
+{
+    uint64_t mix(uint64_t value)
+    {
+        value += 0x9E3779B97F4A7C15ULL;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+        return value ^ (value >> 31);
+    }
+
+    // Boards per thread to keep running at once. More matches are started
+    // while fewer boards than this are playing.
+    const int boards_per_thread = 64;
+}
+
+// A thread count of zero or less uses every hardware thread.
+VersusRunner::VersusRunner(const int num_threads) : pool(num_threads)
+{
+}
+
+int VersusRunner::get_num_threads()
+{
+    return pool.get_num_threads();
+}
+
+// Plays num_matches matches of num_players boards with seeds first_seed,
+// first_seed + 1, ..., each until one board is left or max_ticks ticks have
+// passed. Returns empty results if num_players is out of range.
+VersusRunner::Results VersusRunner::run_matches(const uint64_t first_seed, const int num_matches, const int num_players, const PieceRandomizer::Policy policy, const Player &player, const int max_ticks)
+{
+    Results results;
+    if (num_players < 2 || num_players > max_players)
+    {
+        return results;
+    }
+    results.wins_by_seat.resize(num_players);
+
+    const auto start_time = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<Match>> matches;
+    std::vector<std::pair<Match *, int>> tick_boards;
+    int num_matches_started = 0;
+    while (num_matches_started < num_matches || !matches.empty())
+    {
+        while (num_matches_started < num_matches &&
+               (matches.empty() || int(matches.size()) * num_players < boards_per_thread * pool.get_num_threads()))
+        {
+            auto match = std::make_unique<Match>();
+            match->seed = first_seed + num_matches_started;
+            match->boards.reset(new Board[num_players]);
+            for (int seat = 0; seat < num_players; seat++)
+            {
+                match->boards[seat].game = TetrisGame(match->seed, policy);
+                match->boards[seat].pending_attacks.reserve(num_players);
+                match->alive_seats.push_back(seat);
+            }
+            matches.push_back(std::move(match));
+            num_matches_started++;
+        }
+
+        tick_boards.clear();
+        for (auto &match : matches)
+        {
+            for (auto seat : match->alive_seats)
+            {
+                tick_boards.push_back({match.get(), seat});
+            }
+        }
+        pool.run(tick_boards.size(), [&](int task, int worker)
+                 { play_tick(*tick_boards[task].first, tick_boards[task].second, player, worker); });
+
+        for (size_t x = 0; x < matches.size();)
+        {
+            if (finish_tick(*matches[x], max_ticks, results))
+            {
+                matches[x] = std::move(matches.back());
+                matches.pop_back();
+            }
+            else
+            {
+                x++;
+            }
+        }
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    results.seconds = elapsed.count();
+    return results;
+}
+
+// Adds the garbage sent last tick to the pending attacks and plays a piece.
+// Clearing lines cancels pending garbage and sends what is left over to
+// another board; locking without a clear adds all pending garbage under the
+// stack.
+void VersusRunner::play_tick(Match &match, const int seat, const Player &player, const int worker)
+{
+    Board &board = match.boards[seat];
+    GarbageQueue &incoming = board.queues[match.num_ticks & 1];
+    const int num_incoming = incoming.num_attacks.load(std::memory_order_relaxed);
+    // Attacks arrive in whatever order the threads ran in.
+    std::sort(incoming.attacks.begin(), incoming.attacks.begin() + num_incoming,
+              [](const GarbageAttack &a, const GarbageAttack &b)
+              { return a.sender < b.sender; });
+    board.pending_attacks.insert(board.pending_attacks.end(), incoming.attacks.begin(), incoming.attacks.begin() + num_incoming);
+    incoming.num_attacks.store(0, std::memory_order_relaxed);
+
+    if (!player(board.game, worker))
+    {
+        board.is_alive = false;
+        return;
+    }
+    board.num_pieces++;
+
+    const int num_lines_cleared = board.game.get_last_line_clear().num_lines_cleared;
+    int attack = attack_lines[std::min(num_lines_cleared, int(attack_lines.size()) - 1)];
+    auto pending = board.pending_attacks.begin();
+    while (attack > 0 && pending != board.pending_attacks.end())
+    {
+        const int cancelled = std::min(attack, int(pending->num_lines));
+        attack -= cancelled;
+        pending->num_lines -= cancelled;
+        board.lines_cancelled += cancelled;
+        if (pending->num_lines == 0)
+        {
+            pending++;
+        }
+    }
+    board.pending_attacks.erase(board.pending_attacks.begin(), pending);
+
+    if (num_lines_cleared == 0)
+    {
+        for (auto &pending_attack : board.pending_attacks)
+        {
+            board.game.add_garbage_lines(pending_attack.num_lines, pending_attack.hole_column);
+            board.lines_received += pending_attack.num_lines;
+        }
+        board.pending_attacks.clear();
+    }
+
+    if (attack > 0 && match.alive_seats.size() > 1)
+    {
+        send_attack(match, seat, attack);
+    }
+    board.is_alive = !board.game.get_whether_the_game_is_over();
+}
+
+// Sends garbage to a board picked at random from the others alive at the
+// start of the tick, with the hole in a random column.
+void VersusRunner::send_attack(Match &match, const int seat, const int num_lines)
+{
+    const uint64_t random = mix(match.seed ^ mix((uint64_t(match.num_ticks) << 8) | seat));
+    const int num_others = match.alive_seats.size() - 1;
+    int target = match.alive_seats[random % num_others];
+    if (target == seat)
+    {
+        target = match.alive_seats.back();
+    }
+
+    GarbageQueue &queue = match.boards[target].queues[(match.num_ticks + 1) & 1];
+    const int slot = queue.num_attacks.fetch_add(1, std::memory_order_relaxed);
+    queue.attacks[slot] = {uint8_t(seat), uint8_t(num_lines), uint8_t((random >> 32) % TetrisGame::board_width)};
+    match.boards[seat].lines_sent += num_lines;
+}
+
+// Drops the boards that topped out this tick and returns true, after adding
+// the match to the results, if the match is over.
+bool VersusRunner::finish_tick(Match &match, const int max_ticks, Results &results)
+{
+    match.num_ticks++;
+    match.alive_seats.erase(std::remove_if(match.alive_seats.begin(), match.alive_seats.end(),
+                                           [&](int seat)
+                                           { return !match.boards[seat].is_alive; }),
+                            match.alive_seats.end());
+    if (match.alive_seats.size() > 1 && match.num_ticks < max_ticks)
+    {
+        return false;
+    }
+
+    results.num_matches++;
+    results.num_ticks += match.num_ticks;
+    if (match.alive_seats.size() == 1)
+    {
+        results.wins_by_seat[match.alive_seats[0]]++;
+    }
+    else
+    {
+        results.num_draws++;
+    }
+    for (int seat = 0; seat < int(results.wins_by_seat.size()); seat++)
+    {
+        const Board &board = match.boards[seat];
+        results.num_pieces += board.num_pieces;
+        results.lines_sent += board.lines_sent;
+        results.lines_cancelled += board.lines_cancelled;
+        results.lines_received += board.lines_received;
+    }
+    return true;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "TetrisGame.h"
+#include "ThreadPool.h"
+
+// Plays versus matches between 2 to max_players boards that send each other
+// garbage lines when they clear two or more lines. All boards of a match play
+// the same piece sequence. On every tick each live board of every running
+// match places one piece, and the tick's boards are spread over a thread pool
+// regardless of match, so a few 99-board matches keep every core as busy as
+// many small ones. Garbage sent during a tick is only read by its target on
+// the next tick, so boards never wait on each other within a tick, and targets
+// and holes come from the match seed, so results don't depend on the thread
+// count.
+class VersusRunner
+{
+public:
+    static const int max_players = 99;
+
+    // Plays one piece and returns false if it can't, like BatchRunner::Player.
+    using Player = std::function<bool(TetrisGame &, int)>;
+
+    struct Results
+    {
+        uint64_t num_matches = 0;
+        uint64_t num_ticks = 0;
+        uint64_t num_pieces = 0;
+        uint64_t lines_sent = 0;
+        uint64_t lines_cancelled = 0;
+        uint64_t lines_received = 0;
+        // Matches won by each seat. Matches where the last boards top out on
+        // the same tick, or that reach max_ticks, have no winner.
+        std::vector<uint64_t> wins_by_seat;
+        uint64_t num_draws = 0;
+        double seconds = 0;
+    };
+
+    VersusRunner(const int);
+    int get_num_threads();
+    Results run_matches(const uint64_t, const int, const int, const PieceRandomizer::Policy, const Player &, const int);
+
+private:
+    struct GarbageAttack
+    {
+        uint8_t sender;
+        uint8_t num_lines;
+        uint8_t hole_column;
+    };
+
+    // Attacks sent to one board during one tick. Senders claim slots with an
+    // atomic increment, and the board reads them on the next tick, after the
+    // thread pool's end of batch, so the queue needs no lock. A board can only
+    // be sent one attack per other board per tick.
+    struct GarbageQueue
+    {
+        std::atomic<int> num_attacks{0};
+        std::array<GarbageAttack, max_players> attacks;
+    };
+
+    struct alignas(64) Board
+    {
+        TetrisGame game;
+        // Indexed by the parity of the tick the attacks are read on.
+        GarbageQueue queues[2];
+        // Received and not yet cancelled or added to the board, oldest first.
+        std::vector<GarbageAttack> pending_attacks;
+        bool is_alive = true;
+        uint64_t num_pieces = 0;
+        uint64_t lines_sent = 0;
+        uint64_t lines_cancelled = 0;
+        uint64_t lines_received = 0;
+    };
+
+    struct Match
+    {
+        uint64_t seed;
+        int num_ticks = 0;
+        std::unique_ptr<Board[]> boards;
+        // Seats still playing at the start of the tick, in order.
+        std::vector<uint8_t> alive_seats;
+    };
+
+    // Garbage lines sent for clearing 0 to 4 lines at once.
+    static constexpr std::array<int, 5> attack_lines = {0, 0, 1, 2, 4};
+
+    ThreadPool pool;
+
+    void play_tick(Match &, const int, const Player &, const int);
+    void send_attack(Match &, const int, const int);
+    bool finish_tick(Match &, const int, Results &);
+};
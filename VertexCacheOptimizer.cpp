@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <cmath>
+
+#include "VertexCacheOptimizer.h"
+
+// Reorders the triangles of the triangle list indices, whose vertex indices are
+// below num_vertices, leaving each triangle's winding alone.
+void VertexCacheOptimizer::optimize_triangle_order(std::vector<uint32_t> &indices, const int num_vertices)
+{
+    const int num_triangles = indices.size() / 3;
+
+    // The triangles not yet emitted that use each vertex, as a slice per
+    // vertex of one array, with the emitted ones swapped past the end.
+    std::vector<int> num_triangles_left(num_vertices, 0);
+    for (const uint32_t index : indices)
+    {
+        num_triangles_left[index]++;
+    }
+    std::vector<int> first_triangle(num_vertices + 1, 0);
+    for (int vertex = 0; vertex < num_vertices; vertex++)
+    {
+        first_triangle[vertex + 1] = first_triangle[vertex] + num_triangles_left[vertex];
+    }
+    std::vector<int> vertex_triangles(indices.size());
+    std::vector<int> next_slot(first_triangle.begin(), first_triangle.end() - 1);
+    for (int triangle = 0; triangle < num_triangles; triangle++)
+    {
+        for (int corner = 0; corner < 3; corner++)
+        {
+            vertex_triangles[next_slot[indices[3 * triangle + corner]]++] = triangle;
+        }
+    }
+
+    std::vector<float> vertex_scores(num_vertices);
+    for (int vertex = 0; vertex < num_vertices; vertex++)
+    {
+        vertex_scores[vertex] = get_vertex_score(-1, num_triangles_left[vertex]);
+    }
+    std::vector<float> triangle_scores(num_triangles, 0.0f);
+    for (int triangle = 0; triangle < num_triangles; triangle++)
+    {
+        for (int corner = 0; corner < 3; corner++)
+        {
+            triangle_scores[triangle] += vertex_scores[indices[3 * triangle + corner]];
+        }
+    }
+
+    std::vector<bool> triangle_was_emitted(num_triangles, false);
+    std::vector<int> cache_positions(num_vertices, -1);
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> new_cache;
+    std::vector<uint32_t> new_indices;
+    new_indices.reserve(indices.size());
+
+    int best_triangle = num_triangles > 0 ? int(std::max_element(triangle_scores.begin(), triangle_scores.end()) - triangle_scores.begin()) : -1;
+    while (best_triangle >= 0)
+    {
+        triangle_was_emitted[best_triangle] = true;
+        new_cache.clear();
+        for (int corner = 0; corner < 3; corner++)
+        {
+            const uint32_t vertex = indices[3 * best_triangle + corner];
+            new_indices.push_back(vertex);
+            if (std::find(new_cache.begin(), new_cache.end(), vertex) == new_cache.end())
+            {
+                new_cache.push_back(vertex);
+            }
+
+            const int begin = first_triangle[vertex];
+            const int end = begin + num_triangles_left[vertex];
+            std::swap(*std::find(vertex_triangles.begin() + begin, vertex_triangles.begin() + end, best_triangle), vertex_triangles[end - 1]);
+            num_triangles_left[vertex]--;
+        }
+
+        // The emitted triangle's vertices move to the front of the cache and
+        // push the oldest ones out of it.
+        const int num_emitted_vertices = new_cache.size();
+        for (const uint32_t vertex : cache)
+        {
+            if (std::find(new_cache.begin(), new_cache.begin() + num_emitted_vertices, vertex) == new_cache.begin() + num_emitted_vertices)
+            {
+                new_cache.push_back(vertex);
+            }
+        }
+        for (int position = 0; position < int(new_cache.size()); position++)
+        {
+            const uint32_t vertex = new_cache[position];
+            cache_positions[vertex] = position < cache_size ? position : -1;
+            const float new_score = get_vertex_score(cache_positions[vertex], num_triangles_left[vertex]);
+            const float score_change = new_score - vertex_scores[vertex];
+            vertex_scores[vertex] = new_score;
+            for (int slot = first_triangle[vertex]; slot < first_triangle[vertex] + num_triangles_left[vertex]; slot++)
+            {
+                triangle_scores[vertex_triangles[slot]] += score_change;
+            }
+        }
+        if (int(new_cache.size()) > cache_size)
+        {
+            new_cache.resize(cache_size);
+        }
+        cache.swap(new_cache);
+
+        // The next triangle almost always uses a cached vertex. Only when none
+        // of those are left is every remaining triangle searched.
+        best_triangle = -1;
+        float best_score = -1.0f;
+        for (const uint32_t vertex : cache)
+        {
+            for (int slot = first_triangle[vertex]; slot < first_triangle[vertex] + num_triangles_left[vertex]; slot++)
+            {
+                const int triangle = vertex_triangles[slot];
+                if (triangle_scores[triangle] > best_score)
+                {
+                    best_triangle = triangle;
+                    best_score = triangle_scores[triangle];
+                }
+            }
+        }
+        if (best_triangle < 0)
+        {
+            for (int triangle = 0; triangle < num_triangles; triangle++)
+            {
+                if (!triangle_was_emitted[triangle] && triangle_scores[triangle] > best_score)
+                {
+                    best_triangle = triangle;
+                    best_score = triangle_scores[triangle];
+                }
+            }
+        }
+    }
+
+    indices.swap(new_indices);
+}
+
+// Renumbers the vertices in the order the triangles first use them, so the
+// vertex fetches follow the triangle order too. Returns the old index of each
+// new vertex; vertices no triangle uses are left out.
+std::vector<uint32_t> VertexCacheOptimizer::reorder_vertices_by_first_use(std::vector<uint32_t> &indices, const int num_vertices)
+{
+    const uint32_t unused = UINT32_MAX;
+    std::vector<uint32_t> new_vertex_indices(num_vertices, unused);
+    std::vector<uint32_t> old_vertex_indices;
+    for (uint32_t &index : indices)
+    {
+        if (new_vertex_indices[index] == unused)
+        {
+            new_vertex_indices[index] = old_vertex_indices.size();
+            old_vertex_indices.push_back(index);
+        }
+        index = new_vertex_indices[index];
+    }
+    return old_vertex_indices;
+}
+
+// The vertex shader runs drawing the triangle list indices would take with a
+// first-in, first-out post-transform cache of cache_entries vertices, the way
+// most GPUs reuse transformed vertices.
+int VertexCacheOptimizer::count_cache_misses(const std::vector<uint32_t> &indices, const int num_vertices, const int cache_entries)
+{
+    // Every miss inserts a vertex, and the cache holds the vertices inserted
+    // by the last cache_entries misses.
+    std::vector<int> miss_numbers(num_vertices, -1);
+    int num_misses = 0;
+    for (const uint32_t index : indices)
+    {
+        if (miss_numbers[index] < 0 || num_misses - miss_numbers[index] >= cache_entries)
+        {
+            num_misses++;
+            miss_numbers[index] = num_misses;
+        }
+    }
+    return num_misses;
+}
+
+// A vertex with no triangles left scores below any other, so it never pulls a
+// triangle ahead. The last triangle's vertices get a fixed score a little
+// lower than the next few, since using them again right away tends to make
+// long thin strips.
+float VertexCacheOptimizer::get_vertex_score(const int cache_position, const int num_triangles_left)
+{
+    if (num_triangles_left == 0)
+    {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cache_position >= 3)
+    {
+        score = std::pow(1.0f - float(cache_position - 3) / (cache_size - 3), cache_decay_power);
+    }
+    else if (cache_position >= 0)
+    {
+        score = last_triangle_score;
+    }
+    return score + valence_boost_scale * std::pow(float(num_triangles_left), -valence_boost_power);
+}
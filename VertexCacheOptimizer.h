@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Reorders indexed triangle lists so the GPU's post-transform vertex cache
+// gets as many hits as it can, using Tom Forsyth's linear-speed vertex cache
+// optimization. Triangles are emitted one at a time, always the one whose
+// vertices score best in a simulated cache: recently used vertices score high,
+// and vertices with few triangles left score higher still, so areas of the
+// mesh get finished off instead of leaving stragglers to transform again.
+class VertexCacheOptimizer
+{
+public:
+    static void optimize_triangle_order(std::vector<uint32_t> &, const int);
+    static std::vector<uint32_t> reorder_vertices_by_first_use(std::vector<uint32_t> &, const int);
+    static int count_cache_misses(const std::vector<uint32_t> &, const int, const int);
+
+private:
+    static const int cache_size = 32;
+    static constexpr float cache_decay_power = 1.5f;
+    static constexpr float last_triangle_score = 0.75f;
+    static constexpr float valence_boost_scale = 2.0f;
+    static constexpr float valence_boost_power = 0.5f;
+
+    static float get_vertex_score(const int, const int);
+};
@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TetrisGame.h"
+#include "BatchRunner.h"
+#include "Dataset.h"
+#include "GreedyBot.h"
+
+// Runs many games headless across every core and prints aggregate statistics,
+// either playing seeded games with the greedy bot or re-simulating recorded
+// replays. With --dataset, every game a worker plays is recorded to that
+// worker's file.
+
+bool parse_policy(const char *text, PieceRandomizer::Policy &policy)
+{
+	const char *names[] = {"7bag", "14bag", "tgm", "uniform"};
+	for (int x = 0; x < 4; x++)
+	{
+		if (strcmp(text, names[x]) == 0)
+		{
+			policy = static_cast<PieceRandomizer::Policy>(x);
+			return true;
+		}
+	}
+	return false;
+}
+
+void print_results(const BatchRunner::Results &results)
+{
+	printf("%llu games, %llu pieces in %.3f s (%.0f games/s, %.0f pieces/s)\n",
+		   (unsigned long long)results.num_games, (unsigned long long)results.num_pieces, results.seconds,
+		   results.num_games / results.seconds, results.num_pieces / results.seconds);
+	if (results.num_games == 0)
+	{
+		return;
+	}
+
+	printf("score: mean %.2f, min %d, max %d\n",
+		   double(results.total_score) / results.num_games, results.min_score, results.max_score);
+
+	const char *line_clear_names[] = {"no clear", "single", "double", "triple", "tetris"};
+	for (int x = 0; x < 5; x++)
+	{
+		printf("%-9s %12llu (%5.2f%% of pieces)\n", line_clear_names[x],
+			   (unsigned long long)results.line_clear_counts[x],
+			   results.num_pieces ? 100.0 * results.line_clear_counts[x] / results.num_pieces : 0.0);
+	}
+
+	uint64_t largest_bucket = *std::max_element(results.score_histogram.begin(), results.score_histogram.end());
+	printf("score histogram:\n");
+	for (int x = 0; x < int(results.score_histogram.size()); x++)
+	{
+		const uint64_t games = results.score_histogram[x];
+		printf("%7d-%-7d %10llu |%.*s\n", x * results.score_bucket_size, (x + 1) * results.score_bucket_size - 1,
+			   (unsigned long long)games, int(games * 50 / largest_bucket),
+			   "##################################################");
+	}
+}
+
+void print_usage(const char *program)
+{
+	fprintf(stderr, "Usage: %s [--threads N] [--bucket SIZE] [--policy 7bag|14bag|tgm|uniform] [--seed FIRST_SEED] [--dataset PREFIX] GAMES PIECES\n", program);
+	fprintf(stderr, "       %s [--threads N] [--bucket SIZE] --replays REPLAY_FILE...\n", program);
+	fprintf(stderr, "  --threads N  worker threads, 0 for every hardware thread (default 0)\n");
+	fprintf(stderr, "  --bucket     score histogram bucket size (default 10)\n");
+	fprintf(stderr, "  --dataset    write a training record for every piece placed, to PREFIX.N.tds for worker N\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int num_threads = 0;
+	int bucket_size = 10;
+	uint64_t first_seed = 1;
+	auto policy = PieceRandomizer::Policy::SEVEN_BAG;
+	bool replays_mode = false;
+	const char *dataset_prefix = nullptr;
+
+	int arg = 1;
+	while (arg < argc && strncmp(argv[arg], "--", 2) == 0)
+	{
+		if (strcmp(argv[arg], "--replays") == 0)
+		{
+			replays_mode = true;
+			arg++;
+			break;
+		}
+		if (arg + 1 >= argc)
+		{
+			print_usage(argv[0]);
+			return 1;
+		}
+
+		if (strcmp(argv[arg], "--threads") == 0)
+		{
+			num_threads = atoi(argv[arg + 1]);
+		}
+		else if (strcmp(argv[arg], "--bucket") == 0)
+		{
+			bucket_size = atoi(argv[arg + 1]);
+		}
+		else if (strcmp(argv[arg], "--seed") == 0)
+		{
+			first_seed = strtoull(argv[arg + 1], nullptr, 10);
+		}
+		else if (strcmp(argv[arg], "--dataset") == 0)
+		{
+			dataset_prefix = argv[arg + 1];
+		}
+		else if (strcmp(argv[arg], "--policy") != 0 || !parse_policy(argv[arg + 1], policy))
+		{
+			print_usage(argv[0]);
+			return 1;
+		}
+		arg += 2;
+	}
+
+	BatchRunner runner(num_threads, bucket_size);
+
+	if (replays_mode)
+	{
+		if (arg == argc)
+		{
+			print_usage(argv[0]);
+			return 1;
+		}
+
+		std::vector<Replay> replays(argc - arg);
+		for (int x = 0; x < argc - arg; x++)
+		{
+			if (!replays[x].load(argv[arg + x]))
+			{
+				fprintf(stderr, "Failed to load replay %s\n", argv[arg + x]);
+				return 1;
+			}
+		}
+		print_results(runner.run_replays(replays));
+		return 0;
+	}
+
+	if (argc - arg != 2)
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	const int num_games = atoi(argv[arg]);
+	const int max_pieces = atoi(argv[arg + 1]);
+	GreedyBot bot(runner.get_num_threads());
+	std::vector<std::unique_ptr<DatasetWriter>> dataset_writers;
+	if (dataset_prefix)
+	{
+		for (int x = 0; x < runner.get_num_threads(); x++)
+		{
+			const std::string filename = std::string(dataset_prefix) + "." + std::to_string(x) + ".tds";
+			dataset_writers.emplace_back(new DatasetWriter);
+			if (!dataset_writers.back()->open(filename))
+			{
+				fprintf(stderr, "Failed to create dataset %s\n", filename.c_str());
+				return 1;
+			}
+		}
+	}
+
+	BatchRunner::GameStarter start_game;
+	if (!dataset_writers.empty())
+	{
+		start_game = [&](TetrisGame &game, int worker)
+		{
+			dataset_writers[worker]->begin_game(game);
+		};
+	}
+	print_results(runner.run_players(first_seed, num_games, policy, [&](TetrisGame &game, int worker)
+									 { return bot.play_move(game, worker); },
+									 max_pieces, start_game));
+
+	for (auto &dataset_writer : dataset_writers)
+	{
+		if (!dataset_writer->close())
+		{
+			fprintf(stderr, "Failed to write dataset %s.*.tds\n", dataset_prefix);
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "TetrisGame.h"
+#include "BeamSearchBot.h"
+#include "Dataset.h"
+
+// Lets the beam search bot play a seeded game headless and reports how it did,
+// for stress testing the engine and producing reference replays.
+
+void print_usage(const char *program)
+{
+	fprintf(stderr, "Usage: %s [--threads N] [--beam WIDTH] [--budget MS] [--replay FILE] [--dataset FILE] SEED PIECES\n", program);
+	fprintf(stderr, "  --threads N    search threads, 0 for every hardware thread (default 0)\n");
+	fprintf(stderr, "  --beam WIDTH   states kept at each level of the search (default 256)\n");
+	fprintf(stderr, "  --budget MS    time allowed per move before the search stops deepening (default 100)\n");
+	fprintf(stderr, "  --replay FILE  save the game's inputs as a replay\n");
+	fprintf(stderr, "  --dataset FILE write a training record for every piece placed\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int num_threads = 0;
+	int beam_width = 256;
+	int budget_ms = 100;
+	const char *replay_filename = nullptr;
+	const char *dataset_filename = nullptr;
+
+	int arg = 1;
+	while (arg + 1 < argc && strncmp(argv[arg], "--", 2) == 0)
+	{
+		if (strcmp(argv[arg], "--threads") == 0)
+		{
+			num_threads = atoi(argv[arg + 1]);
+		}
+		else if (strcmp(argv[arg], "--beam") == 0)
+		{
+			beam_width = atoi(argv[arg + 1]);
+		}
+		else if (strcmp(argv[arg], "--budget") == 0)
+		{
+			budget_ms = atoi(argv[arg + 1]);
+		}
+		else if (strcmp(argv[arg], "--replay") == 0)
+		{
+			replay_filename = argv[arg + 1];
+		}
+		else if (strcmp(argv[arg], "--dataset") == 0)
+		{
+			dataset_filename = argv[arg + 1];
+		}
+		else
+		{
+			print_usage(argv[0]);
+			return 1;
+		}
+		arg += 2;
+	}
+
+	if (argc - arg != 2 || beam_width < 1 || budget_ms < 0)
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	const uint64_t seed = strtoull(argv[arg], nullptr, 10);
+	const int num_pieces = atoi(argv[arg + 1]);
+
+	TetrisGame tetris_game(seed);
+	Replay replay(seed, tetris_game.get_policy());
+	if (replay_filename)
+	{
+		tetris_game.record_inputs_to(&replay);
+	}
+	DatasetWriter dataset_writer;
+	if (dataset_filename)
+	{
+		if (!dataset_writer.open(dataset_filename))
+		{
+			fprintf(stderr, "Failed to create dataset %s\n", dataset_filename);
+			return 1;
+		}
+		dataset_writer.begin_game(tetris_game);
+	}
+
+	BeamSearchBot bot(num_threads);
+	auto start_time = std::chrono::steady_clock::now();
+	int pieces_placed = 0;
+	uint64_t total_nodes = 0;
+	uint64_t total_depth = 0;
+	while (pieces_placed < num_pieces &&
+		   bot.play_move(tetris_game, beam_width, std::chrono::milliseconds(budget_ms)))
+	{
+		pieces_placed++;
+		total_nodes += bot.get_last_search_nodes();
+		total_depth += bot.get_last_search_depth();
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+
+	printf("seed %llu: %d pieces, score %d%s\n",
+		   (unsigned long long)seed, pieces_placed, tetris_game.get_score(),
+		   pieces_placed < num_pieces ? " (topped out)" : "");
+	printf("%.1f pieces/s, %.0f nodes/s, average depth %.2f\n",
+		   pieces_placed / elapsed.count(), total_nodes / elapsed.count(),
+		   pieces_placed ? double(total_depth) / pieces_placed : 0.0);
+
+	if (replay_filename && !replay.save(replay_filename))
+	{
+		fprintf(stderr, "Failed to save replay %s\n", replay_filename);
+		return 1;
+	}
+	if (dataset_filename && !dataset_writer.close())
+	{
+		fprintf(stderr, "Failed to write dataset %s\n", dataset_filename);
+		return 1;
+	}
+	return 0;
+}
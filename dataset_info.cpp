@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "TetrisGame.h"
+#include "Dataset.h"
+
+// Summarizes a dataset written by bot_player or batch_runner and times reading
+// every record back, or prints one move of one game.
+
+void print_record(const DatasetRecord &record)
+{
+	const char *piece_letters = "IJLOSZT-";
+	printf("falling %c, held %c, upcoming ", piece_letters[record.falling_piece], piece_letters[record.held_piece]);
+	for (auto piece : record.upcoming_pieces)
+	{
+		printf("%c", piece_letters[piece]);
+	}
+	printf(", %s, %d lines cleared, score %u after\n", record.used_hold ? "held" : "no hold", record.lines_cleared, record.score);
+
+	for (int i = TetrisGame::board_height - 1; i >= 0; i--)
+	{
+		for (int j = 0; j < TetrisGame::board_width; j++)
+		{
+			char square = (record.board_rows[i] >> j) & 1 ? '#' : '.';
+			for (auto position : record.placement)
+			{
+				if (position == i * TetrisGame::board_width + j)
+				{
+					square = '@';
+				}
+			}
+			printf("%c", square);
+		}
+		printf("\n");
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2 && argc != 4)
+	{
+		fprintf(stderr, "Usage: %s DATASET_FILE [GAME MOVE]\n", argv[0]);
+		return 1;
+	}
+
+	DatasetReader reader;
+	if (!reader.open(argv[1]))
+	{
+		fprintf(stderr, "Failed to open dataset %s\n", argv[1]);
+		return 1;
+	}
+
+	DatasetRecord record;
+	if (argc == 4)
+	{
+		if (!reader.read_game_record(strtoull(argv[2], nullptr, 10), atoi(argv[3]), record))
+		{
+			fprintf(stderr, "Failed to read move %s of game %s\n", argv[3], argv[2]);
+			return 1;
+		}
+		print_record(record);
+		return 0;
+	}
+
+	printf("%llu games, %llu records, %llu bytes (%.2f bytes/record, %.1fx smaller than raw)\n",
+		   (unsigned long long)reader.get_num_games(), (unsigned long long)reader.get_num_records(),
+		   (unsigned long long)reader.get_file_size(),
+		   reader.get_num_records() ? double(reader.get_file_size()) / reader.get_num_records() : 0.0,
+		   reader.get_num_records() * double(sizeof(DatasetRecord)) / reader.get_file_size());
+
+	auto start_time = std::chrono::steady_clock::now();
+	uint64_t total_lines_cleared = 0;
+	for (uint64_t x = 0; x < reader.get_num_records(); x++)
+	{
+		if (!reader.read_record(x, record))
+		{
+			fprintf(stderr, "Record %llu is corrupt\n", (unsigned long long)x);
+			return 1;
+		}
+		total_lines_cleared += record.lines_cleared;
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+	printf("read every record in %.3f s (%.0f records/s), %llu lines cleared\n",
+		   elapsed.count(), reader.get_num_records() / elapsed.count(), (unsigned long long)total_lines_cleared);
+	return 0;
+}
@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "TetrisGame.h"
+#include "LockstepBoards.h"
+#include "PlacementGenerator.h"
+
+// Measures the headless engine's hot paths on canned board states and reports
+// time and heap allocations per operation. Every benchmark copies a prepared
+// game into a batch of games outside the timed region, then times the same
+// operation sequence on each copy.
+//
+// With --check-lockstep it instead plays random moves, locks and line clears
+// on LockstepBoards and checks every lane against TetrisGame's rules, to
+// verify whichever SIMD path the engine was built with.
+
+static size_t num_allocations = 0;
+
+void *operator new(size_t size)
+{
+	num_allocations++;
+	if (void *pointer = malloc(size ? size : 1))
+	{
+		return pointer;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+	free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+	free(pointer);
+}
+
+const uint64_t benchmark_seed = 1;
+const int games_per_batch = 1000;
+const auto minimum_benchmark_time = std::chrono::milliseconds(200);
+
+using PT = TetrisGame::PieceType;
+
+template <typename Operation>
+void run_benchmark(const char *name, const TetrisGame &prototype, int ops_per_game, Operation operation)
+{
+	std::chrono::nanoseconds total_time(0);
+	size_t total_allocations = 0;
+	long total_ops = 0;
+
+	while (total_time < minimum_benchmark_time)
+	{
+		std::vector<TetrisGame> games(games_per_batch, prototype);
+
+		size_t allocations_before = num_allocations;
+		auto start_time = std::chrono::steady_clock::now();
+		for (auto &game : games)
+		{
+			operation(game);
+		}
+		total_time += std::chrono::steady_clock::now() - start_time;
+		total_allocations += num_allocations - allocations_before;
+		total_ops += long(games_per_batch) * ops_per_game;
+	}
+
+	printf("%-32s %10.1f ns/op %10.3f allocs/op %12.0f ops/s\n",
+		   name,
+		   double(total_time.count()) / total_ops,
+		   double(total_allocations) / total_ops,
+		   total_ops / std::chrono::duration<double>(total_time).count());
+}
+
+TetrisGame make_game(const std::string &board, PT falling_piece)
+{
+	TetrisGame game(benchmark_seed);
+	if (!game.set_board(board))
+	{
+		fprintf(stderr, "Invalid canned board\n");
+		exit(1);
+	}
+	game.set_falling_piece(falling_piece);
+	return game;
+}
+
+const std::string empty_board = "";
+
+const std::string stacked_board =
+	"....T.....\n"
+	"...TTT....\n"
+	"JJ..ZZ..LL\n"
+	"JIIIIZZ.LL\n"
+	"JSS.OO.ZLL\n"
+	"SSJJOOZZ.L\n"
+	"OOJIIIIZ.T\n"
+	"OOJSS.LLTT\n";
+
+const std::string t_spin_board =
+	"LLL.......\n"
+	"L.........\n"
+	"IIII..SSZZ\n"
+	"JJJ...SSZZ\n"
+	"OOJJ.OOZZS\n";
+
+const std::string tetris_ready_board =
+	"JJJLLLSSS.\n"
+	"OOZZTTTII.\n"
+	"ZZOOSSTLL.\n"
+	"IIIIJJJOO.\n";
+
+const std::string split_lines_board =
+	".JJJLL.SSS\n"
+	"OOZZTT.III\n"
+	".ZOOSS.LLL\n"
+	"IIIIJJ.OOT\n";
+
+using MD = TetrisGame::MovementDirection;
+using OccupancyBoard = TetrisGame::OccupancyBoard;
+
+// Random rows below a random height, each with at least one hole so no row
+// starts out full. Half the rows have only the one hole, so locks clear lines
+// often.
+OccupancyBoard make_random_board(std::mt19937_64 &rng)
+{
+	const TetrisGame::BoardRow full_row = (1 << TetrisGame::board_width) - 1;
+	OccupancyBoard board = {};
+	const int height = rng() % (TetrisGame::board_height - 4);
+	for (int i = 0; i < height; i++)
+	{
+		board[i] = rng() % 2 ? full_row : TetrisGame::BoardRow(rng() | rng());
+		board[i] &= full_row & ~(1 << (rng() % TetrisGame::board_width));
+	}
+	return board;
+}
+
+// A piece of random type and rotation at the top of the board, or false if
+// it doesn't fit there.
+bool spawn_random_piece(std::mt19937_64 &rng, const OccupancyBoard &board, TetrisGame::FallingPiece &piece)
+{
+	piece = TetrisGame::get_spawned_piece(static_cast<PT>(rng() % TetrisGame::num_piece_types));
+	for (int x = rng() % 4; x > 0; x--)
+	{
+		TetrisGame::rotate_piece_if_possible(board, piece, TetrisGame::RotationDirection::RIGHT);
+	}
+	return TetrisGame::positions_are_valid(board, piece.positions);
+}
+
+OccupancyBoard get_piece_board(const TetrisGame::PiecePositions &positions)
+{
+	OccupancyBoard piece = {};
+	for (auto [i, j] : positions)
+	{
+		piece[i] |= TetrisGame::BoardRow(1) << j;
+	}
+	return piece;
+}
+
+int check_lockstep(const long num_operations)
+{
+	const int num_lanes = LockstepBoards::num_lanes;
+	std::mt19937_64 rng(benchmark_seed);
+	static LockstepBoards lockstep;
+	std::vector<OccupancyBoard> boards(num_lanes);
+	std::vector<TetrisGame::FallingPiece> pieces(num_lanes);
+
+	// A lane whose new piece doesn't fit starts over on a new board.
+	auto start_lane = [&](int lane)
+	{
+		while (!spawn_random_piece(rng, boards[lane], pieces[lane]))
+		{
+			boards[lane] = make_random_board(rng);
+			lockstep.set_board(lane, boards[lane]);
+		}
+		lockstep.set_piece(lane, pieces[lane].positions);
+	};
+	lockstep.clear();
+	for (int lane = 0; lane < num_lanes; lane++)
+	{
+		boards[lane] = make_random_board(rng);
+		lockstep.set_board(lane, boards[lane]);
+		start_lane(lane);
+	}
+
+	long num_line_clears = 0;
+	LockstepBoards::LineClears line_clears;
+	for (long operation = 0; operation < num_operations; operation++)
+	{
+		LockstepBoards::LaneMask expected = 0;
+		// Mostly drops, so pieces come to rest and lock often.
+		const int choice = rng() % 8;
+		if (choice < 7)
+		{
+			const MD direction = choice < 2 ? MD::LEFT : choice < 4 ? MD::RIGHT : MD::DOWN;
+			for (int lane = 0; lane < num_lanes; lane++)
+			{
+				expected |= LockstepBoards::LaneMask(TetrisGame::move_piece_if_possible(boards[lane], pieces[lane], direction)) << lane;
+			}
+			if (lockstep.move_pieces(direction) != expected)
+			{
+				fprintf(stderr, "Lanes moved differently on operation %ld\n", operation);
+				return 1;
+			}
+		}
+		else
+		{
+			const LockstepBoards::LaneMask lanes = rng();
+			LockstepBoards::LineClears expected_line_clears;
+			for (int lane = 0; lane < num_lanes; lane++)
+			{
+				if ((lanes >> lane) & 1)
+				{
+					expected_line_clears[lane] = TetrisGame::lock_piece(boards[lane], pieces[lane].positions);
+					expected |= LockstepBoards::LaneMask(expected_line_clears[lane].num_lines_cleared > 0) << lane;
+					num_line_clears += expected_line_clears[lane].num_lines_cleared;
+				}
+			}
+			lockstep.lock_pieces(lanes);
+			bool line_clears_match = lockstep.clear_full_rows(line_clears) == expected;
+			for (int lane = 0; lane < num_lanes; lane++)
+			{
+				line_clears_match = line_clears_match &&
+									line_clears[lane].cleared_rows == expected_line_clears[lane].cleared_rows &&
+									line_clears[lane].num_lines_cleared == expected_line_clears[lane].num_lines_cleared;
+			}
+			if (!line_clears_match)
+			{
+				fprintf(stderr, "Lanes cleared lines differently on operation %ld\n", operation);
+				return 1;
+			}
+			for (int lane = 0; lane < num_lanes; lane++)
+			{
+				if ((lanes >> lane) & 1)
+				{
+					if (lockstep.get_board(lane) != boards[lane])
+					{
+						fprintf(stderr, "Lane %d differs after operation %ld\n", lane, operation);
+						return 1;
+					}
+					start_lane(lane);
+				}
+			}
+		}
+
+		for (int lane = 0; lane < num_lanes; lane++)
+		{
+			if (lockstep.get_board(lane) != boards[lane] || lockstep.get_piece(lane) != get_piece_board(pieces[lane].positions))
+			{
+				fprintf(stderr, "Lane %d differs after operation %ld\n", lane, operation);
+				return 1;
+			}
+		}
+	}
+
+	printf("%s: %ld operations on %d lanes with %ld lines cleared match TetrisGame\n",
+		   LockstepBoards::get_instruction_set(), num_operations, num_lanes, num_line_clears);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 1)
+	{
+		if (strcmp(argv[1], "--check-lockstep") != 0 || argc > 3)
+		{
+			fprintf(stderr, "Usage: %s [--check-lockstep [OPERATIONS]]\n", argv[0]);
+			return 1;
+		}
+		return check_lockstep(argc > 2 ? atol(argv[2]) : 400000);
+	}
+
+	auto t_against_stack = make_game(t_spin_board, PT::T);
+	for (int x = 0; x < 15; x++)
+	{
+		t_against_stack.soft_drop();
+	}
+
+	auto I_against_wall = make_game(empty_board, PT::I);
+	I_against_wall.rotate_right();
+	for (int x = 0; x < TetrisGame::board_width; x++)
+	{
+		I_against_wall.handle_left_input();
+	}
+
+	auto I_over_well = make_game(tetris_ready_board, PT::I);
+	I_over_well.rotate_right();
+	for (int x = 0; x < TetrisGame::board_width; x++)
+	{
+		I_over_well.handle_right_input();
+	}
+
+	auto I_over_split_lines = make_game(split_lines_board, PT::I);
+	I_over_split_lines.rotate_right();
+	I_over_split_lines.handle_right_input();
+
+	printf("%-32s %13s %17s %16s\n", "benchmark", "time", "allocations", "throughput");
+
+	run_benchmark("iterate_time", make_game(stacked_board, PT::T), 100, [](TetrisGame &game)
+				  {
+		for (int x = 0; x < 100; x++)
+		{
+			game.iterate_time();
+		} });
+
+	run_benchmark("hard_drop", make_game(empty_board, PT::I), 5, [](TetrisGame &game)
+				  {
+		for (int x = 0; x < 5; x++)
+		{
+			game.hard_drop();
+		} });
+
+	run_benchmark("handle_left/right_input", make_game(stacked_board, PT::L), 8, [](TetrisGame &game)
+				  {
+		for (int x = 0; x < 4; x++)
+		{
+			game.handle_left_input();
+			game.handle_right_input();
+		} });
+
+	run_benchmark("rotate_left/right (T, stack)", t_against_stack, 32, [](TetrisGame &game)
+				  {
+		for (int x = 0; x < 16; x++)
+		{
+			game.rotate_right();
+			game.rotate_left();
+		} });
+
+	run_benchmark("rotate_left/right (I, wall)", I_against_wall, 32, [](TetrisGame &game)
+				  {
+		for (int x = 0; x < 16; x++)
+		{
+			game.rotate_left();
+			game.rotate_right();
+		} });
+
+	run_benchmark("hold_piece", make_game(stacked_board, PT::S), 1, [](TetrisGame &game)
+				  { game.hold_piece(); });
+
+	run_benchmark("hard_drop + no clear (stack)", make_game(stacked_board, PT::O), 1, [](TetrisGame &game)
+				  { game.hard_drop(); });
+
+	run_benchmark("hard_drop + split clear", I_over_split_lines, 1, [](TetrisGame &game)
+				  { game.hard_drop(); });
+
+	run_benchmark("hard_drop + tetris clear", I_over_well, 1, [](TetrisGame &game)
+				  { game.hard_drop(); });
+
+	static PlacementGenerator placement_generator;
+
+	run_benchmark("generate placements (empty)", make_game(empty_board, PT::T), 1, [](TetrisGame &game)
+				  { placement_generator.generate(game); });
+
+	run_benchmark("generate placements (stack)", make_game(t_spin_board, PT::T), 1, [](TetrisGame &game)
+				  { placement_generator.generate(game); });
+
+	run_benchmark("evaluate_placement", make_game(t_spin_board, PT::T), 1, [](TetrisGame &game)
+				  { game.evaluate_placement(game.get_ghost_positions()); });
+
+	run_benchmark("compute_board_features", make_game(t_spin_board, PT::T), 1, [](TetrisGame &game)
+				  { TetrisGame::compute_board_features(game.get_locked_rows()); });
+
+	return 0;
+}
@@ -4,6 +4,8 @@
 #include <vector>
 #include <unordered_map>
 #include <chrono>
+#include <cstddef>
+#include <memory>
 
 #include <GL/glew.h>
 
@@ -23,7 +25,8 @@ using namespace glm;
 #define GLM_ENABLE_EXPERIMENTAL
 #include "glm/gtx/hash.hpp"
 
-#include "TetrisGame.h"
+#include "GameSimulation.h"
+#include "VertexCacheOptimizer.h"
 
 using namespace std::chrono_literals;
 
@@ -44,7 +47,8 @@ GLuint Z_billboard_texture;
 GLuint T_billboard_texture;
 
 GLuint texture_sampler_id;
-GLuint MVPMatrixID;
+GLuint uv_offset_id;
+GLuint color_textures_id;
 GLuint MMatrixID;
 GLuint VMatrixID;
 GLuint PMatrixID;
@@ -62,27 +66,69 @@ float ambient_component = 0.1f;
 float diffuse_component = 0.85f;
 int specular_exponent = 10;
 
-GLuint piece_type_flag_id;
 GLuint use_lighting_flag_id;
 GLuint use_mvp_flag_id;
 
 std::vector<GLuint> active_buffers;
+std::vector<GLuint> active_vertex_arrays;
 std::vector<GLuint> active_textures;
 
-typedef struct OBJData
+// Each mesh's vertices are interleaved in one buffer and drawn through an
+// index buffer, and its vertex array object is set up once at load time, so
+// drawing it is a bind and a draw.
+struct MeshVertex
 {
-	std::vector<glm::vec3> vertices;
-	std::vector<glm::vec2> uvs;
-	std::vector<glm::vec3> normals;
+	glm::vec3 position;
+	glm::vec2 uv;
+	glm::vec3 normal;
+};
+
+bool operator==(const MeshVertex &a, const MeshVertex &b)
+{
+	return a.position == b.position && a.uv == b.uv && a.normal == b.normal;
+}
+
+namespace std
+{
+	template <>
+	struct hash<MeshVertex>
+	{
+		size_t operator()(const MeshVertex &vertex) const
+		{
+			size_t seed = hash<glm::vec3>()(vertex.position);
+			seed ^= hash<glm::vec2>()(vertex.uv) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+			seed ^= hash<glm::vec3>()(vertex.normal) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+			return seed;
+		}
+	};
+}
+
+struct OBJData
+{
+	GLuint vertex_array;
 	GLuint vertex_buffer;
-	GLuint uv_buffer;
-	GLuint normal_buffer;
+	GLuint index_buffer;
+	GLsizei num_indices;
 };
 
 OBJData tetris_square_obj;
 OBJData scoreboard_obj;
 OBJData hold_obj;
 
+// Every cube of the board, the falling piece and the preview is drawn in one
+// instanced draw call. A cube's model matrix is only a translation, so each
+// instance is its offset plus its BoardSquareColor, and textured says to
+// shade it with that color's texture rather than the flat color.
+struct CubeInstance
+{
+	glm::vec3 offset;
+	GLubyte color;
+	GLubyte textured;
+};
+
+std::vector<CubeInstance> cube_instances;
+GLuint cube_instance_buffer;
+
 glm::mat4 ModelMatrix;
 glm::mat4 ViewMatrix;
 glm::mat4 ProjectionMatrix;
@@ -90,11 +136,9 @@ glm::mat4 ProjectionMatrix;
 bool camera_path_is_shown = false;
 bool camera_paused = false;
 
-TetrisGame tetris_game;
-
-bool soft_drop_is_active = false;
-bool left_is_active = false;
-bool right_is_active = false;
+// The game runs on its own thread; the key handler sends it key events and
+// each frame draws its latest snapshot.
+std::unique_ptr<GameSimulation> simulation;
 
 const float tetris_cube_size = 2.02f;
 
@@ -103,10 +147,6 @@ float light_pos_y = 22.0f;
 float light_pos_z = 7.0f;
 const float light_pos_delta = 3.0f;
 
-int soft_drop_counter = 0;
-int movement_counter = 0;
-int sub_iteration_counter = 0;
-
 const float board_width_gl = TetrisGame::board_width * tetris_cube_size;
 const float board_height_gl = TetrisGame::board_height * tetris_cube_size;
 const float board_x_center = board_width_gl / 2;
@@ -116,7 +156,7 @@ const glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
 const glm::vec3 center = glm::vec3(board_x_center, board_y_center, 0.0f);
 
 const auto time_between_camera_positions = 1500ms;
-auto time_since_camera_change_started = 0ms;
+std::chrono::duration<float> time_since_camera_change_started = 0ms;
 
 const std::array<glm::vec3, 9> camera_positions = {{
 	glm::vec3(0.0f, board_height_gl, 50.0f),
@@ -147,114 +187,154 @@ void generate_gl_buffer(GLuint &buffer)
 }
 
 template <typename T>
-void fill_gl_buffer(GLuint buffer, std::vector<T> buffer_data)
+void fill_gl_buffer(GLenum target, GLuint buffer, std::vector<T> buffer_data)
 {
-	glBindBuffer(GL_ARRAY_BUFFER, buffer);
-	glBufferData(GL_ARRAY_BUFFER, buffer_data.size() * sizeof(T), &buffer_data[0], GL_STATIC_DRAW);
+	glBindBuffer(target, buffer);
+	glBufferData(target, buffer_data.size() * sizeof(T), &buffer_data[0], GL_STATIC_DRAW);
 }
 
 template <typename T>
-void generate_and_fill_gl_buffer(GLuint &buffer, std::vector<T> buffer_data)
+void generate_and_fill_gl_buffer(GLenum target, GLuint &buffer, std::vector<T> buffer_data)
 {
 	generate_gl_buffer(buffer);
-	fill_gl_buffer(buffer, buffer_data);
+	fill_gl_buffer(target, buffer, buffer_data);
 }
 
-void loadOBJ_into_vectors_and_buffers(std::string filename, OBJData &obj_data)
+void loadOBJ_into_vertex_array(std::string filename, OBJData &obj_data)
 {
-	loadOBJ(filename.c_str(), obj_data.vertices, obj_data.uvs, obj_data.normals);
-	generate_and_fill_gl_buffer(obj_data.vertex_buffer, obj_data.vertices);
-	generate_and_fill_gl_buffer(obj_data.uv_buffer, obj_data.uvs);
-	generate_and_fill_gl_buffer(obj_data.normal_buffer, obj_data.normals);
-}
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	loadOBJ(filename.c_str(), positions, uvs, normals);
+
+	// loadOBJ gives every corner of every triangle its own vertex, so the
+	// identical ones are merged and the triangles refer to them by index.
+	std::vector<MeshVertex> unique_vertices;
+	std::vector<uint32_t> indices;
+	std::unordered_map<MeshVertex, uint32_t> vertex_indices;
+	for (size_t x = 0; x < positions.size(); x++)
+	{
+		MeshVertex vertex = {positions[x], uvs[x], normals[x]};
+		auto inserted = vertex_indices.emplace(vertex, unique_vertices.size());
+		if (inserted.second)
+		{
+			unique_vertices.push_back(vertex);
+		}
+		indices.push_back(inserted.first->second);
+	}
 
-void draw_object(GLuint vertexbuffer, GLuint uvbuffer, size_t num_vertices)
-{
-	glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
+	VertexCacheOptimizer::optimize_triangle_order(indices, unique_vertices.size());
+	std::vector<MeshVertex> vertices;
+	for (auto old_index : VertexCacheOptimizer::reorder_vertices_by_first_use(indices, unique_vertices.size()))
+	{
+		vertices.push_back(unique_vertices[old_index]);
+	}
+	obj_data.num_indices = indices.size();
 
-	glUniformMatrix4fv(MVPMatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniformMatrix4fv(MMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
-	glUniformMatrix4fv(VMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-	glUniformMatrix4fv(PMatrixID, 1, GL_FALSE, &ProjectionMatrix[0][0]);
+	glGenVertexArrays(1, &obj_data.vertex_array);
+	active_vertex_arrays.push_back(obj_data.vertex_array);
+	glBindVertexArray(obj_data.vertex_array);
+
+	generate_and_fill_gl_buffer(GL_ARRAY_BUFFER, obj_data.vertex_buffer, vertices);
+	generate_and_fill_gl_buffer(GL_ELEMENT_ARRAY_BUFFER, obj_data.index_buffer, indices);
 
 	glEnableVertexAttribArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-	glVertexAttribPointer(
-		0,		  // attribute
-		3,		  // size
-		GL_FLOAT, // type
-		GL_FALSE, // normalized?
-		0,		  // stride
-		(void *)0 // array buffer offset
-	);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void *)offsetof(MeshVertex, position));
 
 	glEnableVertexAttribArray(1);
-	glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-	glVertexAttribPointer(
-		1,		  // attribute
-		2,		  // size
-		GL_FLOAT, // type
-		GL_FALSE, // normalized?
-		0,		  // stride
-		(void *)0 // array buffer offset
-	);
-
-	glDrawArrays(GL_TRIANGLES, 0, num_vertices);
-
-	glDisableVertexAttribArray(0);
-	glDisableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void *)offsetof(MeshVertex, uv));
+
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void *)offsetof(MeshVertex, normal));
+
+	glBindVertexArray(0);
 }
 
-void draw_object_with_normals(GLuint vertexbuffer, GLuint uvbuffer, GLuint normalbuffer, size_t num_vertices)
+// Adds the per-instance attributes, read from cube_instance_buffer, to the
+// cube's vertex array.
+void add_cube_instance_attributes()
 {
-	// 3rd attribute buffer : normals
-	glEnableVertexAttribArray(2);
-	glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
-	glVertexAttribPointer(
-		2,		  // attribute
-		3,		  // size
-		GL_FLOAT, // type
-		GL_FALSE, // normalized?
-		0,		  // stride
-		(void *)0 // array buffer offset
-	);
-
-	draw_object(vertexbuffer, uvbuffer, num_vertices);
-
-	glDisableVertexAttribArray(2);
+	glBindVertexArray(tetris_square_obj.vertex_array);
+	glBindBuffer(GL_ARRAY_BUFFER, cube_instance_buffer);
+
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(CubeInstance), (void *)offsetof(CubeInstance, offset));
+	glVertexAttribDivisor(3, 1);
+
+	glEnableVertexAttribArray(4);
+	glVertexAttribIPointer(4, 2, GL_UNSIGNED_BYTE, sizeof(CubeInstance), (void *)offsetof(CubeInstance, color));
+	glVertexAttribDivisor(4, 1);
+
+	glBindVertexArray(0);
 }
 
-void draw_tetris_square()
+// Uniforms that stay the same for every draw call in a frame.
+void set_frame_uniforms()
 {
+	glUniformMatrix4fv(VMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
+	glUniformMatrix4fv(PMatrixID, 1, GL_FALSE, &ProjectionMatrix[0][0]);
+
 	glUniform3f(LightID, light_pos_x, light_pos_y, light_pos_z);
 
 	glUniform1f(ambient_id, ambient_component);
 	glUniform1f(diffuse_id, diffuse_component);
 	glUniform1i(specular_id, specular_exponent);
+}
 
+void draw_object(const OBJData &obj_data, glm::vec2 uv_offset)
+{
+	glUniformMatrix4fv(MMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
+	glUniform2f(uv_offset_id, uv_offset.x, uv_offset.y);
+
+	glBindVertexArray(obj_data.vertex_array);
+	glDrawElements(GL_TRIANGLES, obj_data.num_indices, GL_UNSIGNED_INT, (void *)0);
+}
+
+void add_cube(float x, float y, TetrisGame::BoardSquareColor color, bool textured)
+{
+	cube_instances.push_back({vec3(x, y, 0.0f), GLubyte(color), GLubyte(textured)});
+}
+
+void draw_cubes()
+{
 	glUniform1i(use_lighting_flag_id, 1);
+	glUniform2f(uv_offset_id, 0.0f, 0.0f);
+
+	glBindBuffer(GL_ARRAY_BUFFER, cube_instance_buffer);
+	glBufferData(GL_ARRAY_BUFFER, cube_instances.size() * sizeof(CubeInstance), cube_instances.data(), GL_STREAM_DRAW);
 
-	draw_object_with_normals(tetris_square_obj.vertex_buffer, tetris_square_obj.uv_buffer, tetris_square_obj.normal_buffer, tetris_square_obj.vertices.size());
+	glBindVertexArray(tetris_square_obj.vertex_array);
+	glDrawElementsInstanced(GL_TRIANGLES, tetris_square_obj.num_indices, GL_UNSIGNED_INT, (void *)0, cube_instances.size());
+
+	cube_instances.clear();
 }
 
-void draw_tetris_board()
+// The falling piece is drawn fall_offset rows below where it is in the
+// snapshot, so it moves down smoothly between ticks.
+void add_tetris_board_cubes(const GameSimulation::Snapshot &snapshot, float fall_offset)
 {
 	for (int i = 0; i < TetrisGame::board_height; i++)
 	{
 		for (int j = 0; j < TetrisGame::board_width; j++)
 		{
-			auto square = tetris_game.get_square(i, j);
+			auto square = snapshot.board[i][j];
 			if (square != TetrisGame::BoardSquareColor::EMPTY)
 			{
-				glUniform1i(piece_type_flag_id, (int)square);
-				ModelMatrix = glm::translate(vec3(j * tetris_cube_size, i * tetris_cube_size, 0.0f));
-				draw_tetris_square();
+				add_cube(j * tetris_cube_size, i * tetris_cube_size, square, false);
 			}
 		}
 	}
+
+	if (snapshot.a_piece_is_falling)
+	{
+		for (auto [i, j] : snapshot.falling_piece_positions)
+		{
+			add_cube(j * tetris_cube_size, (i - fall_offset) * tetris_cube_size, snapshot.falling_piece_color, false);
+		}
+	}
 }
 
-void draw_held_tetris_piece()
+void draw_held_tetris_piece(const GameSimulation::Snapshot &snapshot)
 {
 	glm::vec3 billboard_center = glm::vec3(-8.0f, board_height_gl - 5.0f, 0.0f);
 	ModelMatrix = glm::rotate(glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
@@ -266,7 +346,7 @@ void draw_held_tetris_piece()
 
 	glm::vec2 billboard_size;
 
-	auto held_piece_type = tetris_game.get_held_piece();
+	auto held_piece_type = snapshot.held_piece;
 
 	using PT = TetrisGame::PieceType;
 	switch (held_piece_type)
@@ -313,14 +393,13 @@ void draw_held_tetris_piece()
 	glBindTexture(GL_TEXTURE_2D, current_texture);
 	glUniform1i(texture_sampler_id, 0);
 
-	glUniform1i(piece_type_flag_id, -1);
 	glUniform1i(use_lighting_flag_id, 0);
 	glUniform1i(use_mvp_flag_id, 1);
 
-	draw_object(hold_obj.vertex_buffer, hold_obj.uv_buffer, hold_obj.vertices.size());
+	draw_object(hold_obj, glm::vec2(0.0f, 0.0f));
 }
 
-void draw_upcoming_pieces(float y_offset)
+void add_upcoming_piece_cubes(const GameSimulation::Snapshot &snapshot, float y_offset)
 {
 	for (int i = 0; i < TetrisGame::num_upcoming_pieces_shown; i++)
 	{
@@ -328,41 +407,12 @@ void draw_upcoming_pieces(float y_offset)
 		{
 			for (int k = 0; k < TetrisGame::upcoming_board_width; k++)
 			{
-				using BSC = TetrisGame::BoardSquareColor;
-				auto square = tetris_game.get_upcoming_square(i, j, k);
-				if (square != BSC::EMPTY)
+				auto square = snapshot.upcoming_pieces[i][j][k];
+				if (square != TetrisGame::BoardSquareColor::EMPTY)
 				{
-					glActiveTexture(GL_TEXTURE0);
-					switch (square)
-					{
-					case BSC::LIGHT_BLUE:
-						glBindTexture(GL_TEXTURE_2D, light_blue_texture);
-						break;
-					case BSC::DARK_BLUE:
-						glBindTexture(GL_TEXTURE_2D, dark_blue_texture);
-						break;
-					case BSC::GREEN:
-						glBindTexture(GL_TEXTURE_2D, green_texture);
-						break;
-					case BSC::YELLOW:
-						glBindTexture(GL_TEXTURE_2D, yellow_texture);
-						break;
-					case BSC::ORANGE:
-						glBindTexture(GL_TEXTURE_2D, orange_texture);
-						break;
-					case BSC::RED:
-						glBindTexture(GL_TEXTURE_2D, red_texture);
-						break;
-					case BSC::MAGENTA:
-						glBindTexture(GL_TEXTURE_2D, purple_texture);
-						break;
-					}
-					glUniform1i(texture_sampler_id, 0);
-					glUniform1i(piece_type_flag_id, -1);
 					float x = (k + TetrisGame::board_width * 5 / 4) * tetris_cube_size;
 					float y = board_height_gl - (TetrisGame::num_upcoming_pieces_shown - i - 1) * TetrisGame::upcoming_board_lines_per_piece * tetris_cube_size + j * tetris_cube_size - y_offset;
-					ModelMatrix = glm::translate(vec3(x, y, 0.0f));
-					draw_tetris_square();
+					add_cube(x, y, square, true);
 				}
 			}
 		}
@@ -377,11 +427,9 @@ void draw_scoreboard_digit(int digit_place, int digit_value)
 	glBindTexture(GL_TEXTURE_2D, ssd_digit_texture);
 	glUniform1i(texture_sampler_id, 0);
 
-	glUniform1i(piece_type_flag_id, -1);
 	glUniform1i(use_lighting_flag_id, 0);
 	glUniform1i(use_mvp_flag_id, 0);
 
-	std::vector<glm::vec2> current_uvs;
 	int displacement_x;
 	int displacement_y;
 	if (digit_value == 0)
@@ -395,14 +443,8 @@ void draw_scoreboard_digit(int digit_place, int digit_value)
 		displacement_y = (digit_value - 1) / 5;
 	}
 
-	for (auto xy : scoreboard_obj.uvs)
-	{
-		current_uvs.push_back(glm::vec2(xy.x + (0.2 * displacement_x), xy.y - (0.5 * displacement_y)));
-	}
-
-	fill_gl_buffer(scoreboard_obj.uv_buffer, current_uvs);
-
-	draw_object(scoreboard_obj.vertex_buffer, scoreboard_obj.uv_buffer, scoreboard_obj.vertices.size());
+	// The digits are laid out 5 by 2 in the texture.
+	draw_object(scoreboard_obj, glm::vec2(0.2f * displacement_x, -0.5f * displacement_y));
 }
 
 void draw_scoreboard(int score)
@@ -451,34 +493,28 @@ void decrement_and_print_value_with_min(T &value, T delta, T min_value)
 
 void key_handler(GLFWwindow *window, int key, int scancode, int action, int mods)
 {
+	using Key = GameSimulation::Key;
 	if (action == GLFW_PRESS)
 	{
 		switch (key)
 		{
 		case GLFW_KEY_W:
-			tetris_game.soft_drop();
-			soft_drop_is_active = true;
-			soft_drop_counter = 0;
-			sub_iteration_counter = 0;
+			simulation->press(Key::SOFT_DROP);
 			break;
 		case GLFW_KEY_S:
-			tetris_game.hard_drop();
+			simulation->press(Key::HARD_DROP);
 			break;
 		case GLFW_KEY_A:
-			tetris_game.handle_left_input();
-			left_is_active = true;
-			movement_counter = 0;
+			simulation->press(Key::LEFT);
 			break;
 		case GLFW_KEY_D:
-			tetris_game.handle_right_input();
-			right_is_active = true;
-			movement_counter = 0;
+			simulation->press(Key::RIGHT);
 			break;
 		case GLFW_KEY_LEFT:
-			tetris_game.rotate_left();
+			simulation->press(Key::ROTATE_LEFT);
 			break;
 		case GLFW_KEY_RIGHT:
-			tetris_game.rotate_right();
+			simulation->press(Key::ROTATE_RIGHT);
 			break;
 		case GLFW_KEY_KP_7:
 			decrement_and_print_value_with_min(light_pos_x, light_pos_delta, -1000.0f);
@@ -547,7 +583,7 @@ void key_handler(GLFWwindow *window, int key, int scancode, int action, int mods
 			begin_moving_camera_to(camera_positions[8]);
 			break;
 		case GLFW_KEY_LEFT_SHIFT:
-			tetris_game.hold_piece();
+			simulation->press(Key::HOLD);
 			break;
 		}
 	}
@@ -556,13 +592,13 @@ void key_handler(GLFWwindow *window, int key, int scancode, int action, int mods
 		switch (key)
 		{
 		case GLFW_KEY_W:
-			soft_drop_is_active = false;
+			simulation->release(Key::SOFT_DROP);
 			break;
 		case GLFW_KEY_A:
-			left_is_active = false;
+			simulation->release(Key::LEFT);
 			break;
 		case GLFW_KEY_D:
-			right_is_active = false;
+			simulation->release(Key::RIGHT);
 			break;
 		}
 	}
@@ -608,6 +644,8 @@ int main(void)
 	// Ensure we can capture the escape key being pressed below
 	glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
 
+	simulation.reset(new GameSimulation(TetrisGame()));
+
 	glfwSetKeyCallback(window, key_handler);
 
 	// Background
@@ -621,14 +659,9 @@ int main(void)
 	// Cull triangles which normal is not towards the camera
 	glEnable(GL_CULL_FACE);
 
-	GLuint VertexArrayID;
-	glGenVertexArrays(1, &VertexArrayID);
-	glBindVertexArray(VertexArrayID);
-
 	// Create and compile our GLSL program from the shaders
 	GLuint programID = LoadShaders("TransformVertexShader.glsl", "TextureFragmentShader.glsl");
 
-	MVPMatrixID = glGetUniformLocation(programID, "MVP");
 	MMatrixID = glGetUniformLocation(programID, "M");
 	VMatrixID = glGetUniformLocation(programID, "V");
 	PMatrixID = glGetUniformLocation(programID, "P");
@@ -658,31 +691,38 @@ int main(void)
 	load_texture(T_billboard_texture, "textures/billboards/T.DDS");
 
 	texture_sampler_id = glGetUniformLocation(programID, "textureSampler");
-	piece_type_flag_id = glGetUniformLocation(programID, "piece_type");
+	uv_offset_id = glGetUniformLocation(programID, "uv_offset");
+	color_textures_id = glGetUniformLocation(programID, "color_textures");
 	use_lighting_flag_id = glGetUniformLocation(programID, "use_lighting");
 	use_mvp_flag_id = glGetUniformLocation(programID, "use_mvp");
 
-	loadOBJ_into_vectors_and_buffers("objs/tetris_cube_more_beveled.obj", tetris_square_obj);
-	loadOBJ_into_vectors_and_buffers("objs/SSD_Digit.obj", scoreboard_obj);
-	loadOBJ_into_vectors_and_buffers("objs/hold.obj", hold_obj);
+	loadOBJ_into_vertex_array("objs/tetris_cube_more_beveled.obj", tetris_square_obj);
+	loadOBJ_into_vertex_array("objs/SSD_Digit.obj", scoreboard_obj);
+	loadOBJ_into_vertex_array("objs/hold.obj", hold_obj);
 
-	auto lastTime = std::chrono::system_clock::now();
-
-	ProjectionMatrix = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 205.0f);
+	generate_gl_buffer(cube_instance_buffer);
+	add_cube_instance_attributes();
 
-	int i = 0;
+	// The preview's color textures stay bound to units 1 to 7, in
+	// BoardSquareColor order, for the whole game.
+	const GLuint color_textures[] = {light_blue_texture, dark_blue_texture, orange_texture, yellow_texture, green_texture, red_texture, purple_texture};
+	GLint color_texture_units[7];
+	for (int x = 0; x < 7; x++)
+	{
+		glActiveTexture(GL_TEXTURE1 + x);
+		glBindTexture(GL_TEXTURE_2D, color_textures[x]);
+		color_texture_units[x] = 1 + x;
+	}
+	glUseProgram(programID);
+	glUniform1iv(color_textures_id, 7, color_texture_units);
 
-	const int sub_iterations_per_soft_drop = 3;
-	const int sub_iterations_per_movement = 5;
-	const int sub_iterations_per_iteration = 15;
+	auto lastTime = std::chrono::steady_clock::now();
 
-	auto iteration_time = 500ms;
-	auto sub_iteration_time = iteration_time / sub_iterations_per_iteration;
-	auto time_since_last_sub_iteration = 0ms;
+	ProjectionMatrix = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 205.0f);
 
 	float upcoming_piece_y_offset = 0;
 	const auto y_offset_period = 5000ms;
-	auto y_offset_timer = 0ms;
+	std::chrono::duration<float> y_offset_timer = 0ms;
 	bool y_offset_is_increasing = true;
 	float y_offset_fraction;
 	const float y_offset_max = 5.0f;
@@ -699,28 +739,29 @@ int main(void)
 		// Use our shader
 		glUseProgram(programID);
 
-		auto currentTime = std::chrono::system_clock::now();
-		auto deltaTime = currentTime - lastTime;
-		auto deltaTimeInMS = std::chrono::duration_cast<std::chrono::milliseconds>(deltaTime);
+		// Animations advance by the real time between frames, unrounded, so
+		// they run at the same speed at any frame rate.
+		auto currentTime = std::chrono::steady_clock::now();
+		std::chrono::duration<float> deltaTime = currentTime - lastTime;
 		lastTime = currentTime;
 
 		if (time_since_camera_change_started < time_between_camera_positions)
 		{
-			time_since_camera_change_started += deltaTimeInMS;
-			position_fraction = float(time_since_camera_change_started.count()) / float(time_between_camera_positions.count());
+			time_since_camera_change_started += deltaTime;
+			position_fraction = std::min(time_since_camera_change_started / time_between_camera_positions, 1.0f);
 			position = (1.0f - position_fraction) * original_position + position_fraction * destination_position;
 			ViewMatrix = glm::lookAt(position, center, up);
 		}
 
-		y_offset_timer += deltaTimeInMS;
+		y_offset_timer += deltaTime;
 
-		if (y_offset_timer > y_offset_period)
+		while (y_offset_timer > y_offset_period)
 		{
 			y_offset_timer -= y_offset_period;
 			y_offset_is_increasing = !y_offset_is_increasing;
 		}
 
-		y_offset_fraction = float(y_offset_timer.count()) / float(y_offset_period.count());
+		y_offset_fraction = y_offset_timer / y_offset_period;
 
 		if (y_offset_is_increasing)
 		{
@@ -731,61 +772,21 @@ int main(void)
 			upcoming_piece_y_offset = y_offset_max - y_offset_fraction * y_offset_max;
 		}
 
-		draw_tetris_board();
-		draw_upcoming_pieces(upcoming_piece_y_offset);
-		draw_scoreboard(tetris_game.get_score());
-		if (tetris_game.get_whether_a_piece_is_held())
+		const GameSimulation::Snapshot &snapshot = simulation->get_latest_snapshot();
+		set_frame_uniforms();
+		add_tetris_board_cubes(snapshot, GameSimulation::get_fall_offset(snapshot, currentTime));
+		add_upcoming_piece_cubes(snapshot, upcoming_piece_y_offset);
+		draw_cubes();
+		draw_scoreboard(snapshot.score);
+		if (snapshot.a_piece_is_held)
 		{
-			draw_held_tetris_piece();
+			draw_held_tetris_piece(snapshot);
 		}
 
 		// Swap buffers
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 
-		time_since_last_sub_iteration += deltaTimeInMS;
-
-		if (time_since_last_sub_iteration > sub_iteration_time)
-		{
-			sub_iteration_counter++;
-
-			if (soft_drop_is_active)
-			{
-				soft_drop_counter++;
-				if (soft_drop_counter == sub_iterations_per_soft_drop)
-				{
-					soft_drop_counter = 0;
-					sub_iteration_counter = 0;
-					tetris_game.soft_drop();
-				}
-			}
-
-			if (left_is_active ^ right_is_active)
-			{
-				movement_counter++;
-				if (movement_counter == sub_iterations_per_movement)
-				{
-					movement_counter = 0;
-					if (left_is_active)
-					{
-						tetris_game.handle_left_input();
-					}
-					else
-					{
-						tetris_game.handle_right_input();
-					}
-				}
-			}
-
-			if (sub_iteration_counter == sub_iterations_per_iteration)
-			{
-				sub_iteration_counter = 0;
-				tetris_game.iterate_time();
-			}
-
-			time_since_last_sub_iteration -= sub_iteration_time;
-		}
-
 	} // Check if the ESC key was pressed or the window was closed
 	while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
 		   glfwWindowShouldClose(window) == 0);
@@ -794,7 +795,9 @@ int main(void)
 	glDeleteBuffers(active_buffers.size(), active_buffers.data());
 	glDeleteTextures(active_textures.size(), active_textures.data());
 	glDeleteProgram(programID);
-	glDeleteVertexArrays(1, &VertexArrayID);
+	glDeleteVertexArrays(active_vertex_arrays.size(), active_vertex_arrays.data());
+
+	simulation.reset();
 
 	// Close OpenGL window and terminate GLFW
 	glfwTerminate();
@@ -0,0 +1,286 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "TetrisGame.h"
+#include "MatchProtocol.h"
+
+// A stand-in for remote bots that plays random inputs on many connections to
+// match_server at once. Every connection also plays its inputs on a local game
+// and checks the server's STATE frames against it, and the round trip time of
+// every frame is reported.
+
+using Protocol = MatchProtocol;
+using Input = Replay::Input;
+
+struct Connection
+{
+	int fd;
+	uint64_t seed;
+	TetrisGame game;
+	Protocol::GameView view;
+	std::chrono::steady_clock::time_point sent_time;
+};
+
+bool connect_to_server(const char *tcp_address, const char *unix_path, int &fd)
+{
+	if (unix_path)
+	{
+		sockaddr_un address = {};
+		if (strlen(unix_path) >= sizeof(address.sun_path))
+		{
+			return false;
+		}
+		address.sun_family = AF_UNIX;
+		strcpy(address.sun_path, unix_path);
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		return fd >= 0 && connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+	}
+
+	const char *colon = strrchr(tcp_address, ':');
+	if (!colon)
+	{
+		return false;
+	}
+	const std::string host(tcp_address, colon);
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(atoi(colon + 1));
+	if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1)
+	{
+		return false;
+	}
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	const int enable = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+	return fd >= 0 && connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+}
+
+bool send_all(int fd, const uint8_t *bytes, int size)
+{
+	while (size > 0)
+	{
+		const ssize_t written = send(fd, bytes, size, MSG_NOSIGNAL);
+		if (written <= 0)
+		{
+			return false;
+		}
+		bytes += written;
+		size -= written;
+	}
+	return true;
+}
+
+bool receive_all(int fd, uint8_t *bytes, int size)
+{
+	while (size > 0)
+	{
+		const ssize_t num_read = recv(fd, bytes, size, 0);
+		if (num_read <= 0)
+		{
+			return false;
+		}
+		bytes += num_read;
+		size -= num_read;
+	}
+	return true;
+}
+
+// Reads the reply to the last frame sent and checks it against the local game.
+// Returns false if the connection failed or the reply was malformed.
+bool receive_state(Connection &connection, int &num_bytes, bool &matches)
+{
+	uint8_t frame[Protocol::max_frame_size];
+	if (!receive_all(connection.fd, frame, Protocol::header_size) ||
+		frame[0] != static_cast<uint8_t>(Protocol::FrameType::STATE) ||
+		!receive_all(connection.fd, frame + Protocol::header_size, frame[1]) ||
+		!Protocol::read_state(frame + Protocol::header_size, frame[1], connection.view))
+	{
+		return false;
+	}
+	num_bytes = Protocol::header_size + frame[1];
+
+	const auto expected = Protocol::get_view(connection.game);
+	const auto &view = connection.view;
+	matches = view.rows == expected.rows &&
+			  view.falling_piece == expected.falling_piece &&
+			  view.held_piece == expected.held_piece &&
+			  std::equal(view.upcoming_pieces, view.upcoming_pieces + TetrisGame::num_upcoming_pieces_shown, expected.upcoming_pieces) &&
+			  view.score == expected.score &&
+			  view.game_is_over == expected.game_is_over;
+	return true;
+}
+
+bool start_game(Connection &connection, uint64_t seed)
+{
+	uint8_t frame[Protocol::max_frame_size];
+	connection.seed = seed;
+	connection.game = TetrisGame(seed);
+	connection.view = Protocol::GameView();
+	return send_all(connection.fd, frame, Protocol::write_start(frame, seed, connection.game.get_policy()));
+}
+
+void print_usage(const char *program)
+{
+	fprintf(stderr, "Usage: %s [--connections N] [--frames N] [--inputs N] --tcp HOST:PORT|--unix PATH\n", program);
+	fprintf(stderr, "  --connections N  games played at once (default 100)\n");
+	fprintf(stderr, "  --frames N       INPUTS frames sent on each connection (default 1000)\n");
+	fprintf(stderr, "  --inputs N       inputs per frame (default 4)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int num_connections = 100;
+	int num_frames = 1000;
+	int inputs_per_frame = 4;
+	const char *tcp_address = nullptr;
+	const char *unix_path = nullptr;
+
+	for (int arg = 1; arg < argc; arg += 2)
+	{
+		if (arg + 1 >= argc)
+		{
+			print_usage(argv[0]);
+			return 1;
+		}
+		if (strcmp(argv[arg], "--connections") == 0)
+		{
+			num_connections = atoi(argv[arg + 1]);
+		}
+		else if (strcmp(argv[arg], "--frames") == 0)
+		{
+			num_frames = atoi(argv[arg + 1]);
+		}
+		else if (strcmp(argv[arg], "--inputs") == 0)
+		{
+			inputs_per_frame = atoi(argv[arg + 1]);
+		}
+		else if (strcmp(argv[arg], "--tcp") == 0)
+		{
+			tcp_address = argv[arg + 1];
+		}
+		else if (strcmp(argv[arg], "--unix") == 0)
+		{
+			unix_path = argv[arg + 1];
+		}
+		else
+		{
+			print_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (!tcp_address == !unix_path || num_connections < 1 || num_frames < 0 ||
+		inputs_per_frame < 1 || inputs_per_frame > Protocol::max_inputs_per_frame)
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	std::vector<Connection> connections(num_connections);
+	uint64_t next_seed = 1;
+	uint64_t num_mismatches = 0;
+	uint64_t num_games = 0;
+	uint64_t num_bytes_received = 0;
+	int num_bytes;
+	bool matches;
+	for (auto &connection : connections)
+	{
+		if (!connect_to_server(tcp_address, unix_path, connection.fd) ||
+			!start_game(connection, next_seed++) ||
+			!receive_state(connection, num_bytes, matches))
+		{
+			fprintf(stderr, "Failed to connect to the server: %s\n", strerror(errno));
+			return 1;
+		}
+		num_games++;
+		num_mismatches += !matches;
+	}
+
+	// Each round sends a frame on every connection and then collects the
+	// replies, so up to num_connections frames are in flight at once.
+	uint64_t random_state = 12345;
+	std::vector<double> round_trip_times;
+	round_trip_times.reserve(size_t(num_frames) * num_connections);
+	const auto start_time = std::chrono::steady_clock::now();
+	for (int frame_index = 0; frame_index < num_frames; frame_index++)
+	{
+		for (auto &connection : connections)
+		{
+			Input inputs[Protocol::max_inputs_per_frame];
+			for (int x = 0; x < inputs_per_frame; x++)
+			{
+				random_state ^= random_state << 13;
+				random_state ^= random_state >> 7;
+				random_state ^= random_state << 17;
+				inputs[x] = random_state % 16 == 0 ? Input::HARD_DROP : static_cast<Input>(random_state % 8);
+				// The server ignores the inputs left after a game ends.
+				if (!connection.game.get_whether_the_game_is_over())
+				{
+					connection.game.apply_input(inputs[x]);
+				}
+			}
+			uint8_t frame[Protocol::max_frame_size];
+			connection.sent_time = std::chrono::steady_clock::now();
+			if (!send_all(connection.fd, frame, Protocol::write_inputs(frame, inputs, inputs_per_frame)))
+			{
+				fprintf(stderr, "Lost the connection to the server\n");
+				return 1;
+			}
+		}
+
+		for (auto &connection : connections)
+		{
+			if (!receive_state(connection, num_bytes, matches))
+			{
+				fprintf(stderr, "Lost the connection to the server\n");
+				return 1;
+			}
+			const std::chrono::duration<double, std::micro> round_trip_time = std::chrono::steady_clock::now() - connection.sent_time;
+			round_trip_times.push_back(round_trip_time.count());
+			num_bytes_received += num_bytes;
+			num_mismatches += !matches;
+
+			if (connection.game.get_whether_the_game_is_over())
+			{
+				if (!start_game(connection, next_seed++) || !receive_state(connection, num_bytes, matches))
+				{
+					fprintf(stderr, "Lost the connection to the server\n");
+					return 1;
+				}
+				num_games++;
+				num_mismatches += !matches;
+			}
+		}
+	}
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+
+	for (auto &connection : connections)
+	{
+		close(connection.fd);
+	}
+
+	const uint64_t num_input_frames = round_trip_times.size();
+	printf("%d connections, %llu games, %llu input frames in %.3f s (%.0f frames/s, %.0f inputs/s)\n",
+		   num_connections, (unsigned long long)num_games, (unsigned long long)num_input_frames, elapsed.count(),
+		   num_input_frames / elapsed.count(), num_input_frames * inputs_per_frame / elapsed.count());
+	if (num_input_frames > 0)
+	{
+		std::sort(round_trip_times.begin(), round_trip_times.end());
+		printf("round trip: median %.1f us, 99th percentile %.1f us, max %.1f us; %.1f bytes per reply\n",
+			   round_trip_times[num_input_frames / 2], round_trip_times[num_input_frames * 99 / 100],
+			   round_trip_times.back(), double(num_bytes_received) / num_input_frames);
+	}
+	printf("%llu replies differed from the local game\n", (unsigned long long)num_mismatches);
+	return num_mismatches == 0 ? 0 : 1;
+}
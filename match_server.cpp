@@ -0,0 +1,374 @@
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TetrisGame.h"
+#include "MatchProtocol.h"
+
+// Hosts many headless games for remote bots over TCP or a Unix socket, one
+// game per connection, speaking MatchProtocol. Each thread runs its own epoll
+// loop over the connections it accepted, and every connection's buffers are a
+// fixed size: a client that stops reading its STATE frames stops having its
+// inputs read until it catches up, rather than growing the server's memory.
+
+using Protocol = MatchProtocol;
+
+static std::atomic<bool> stopping(false);
+static std::atomic<int> num_sessions(0);
+
+struct Session
+{
+	static const int input_buffer_size = 4 * Protocol::max_frame_size;
+	static const int output_buffer_size = 16 * Protocol::max_frame_size;
+
+	int fd;
+	bool game_started = false;
+	TetrisGame game;
+	TetrisGame::OccupancyBoard sent_rows = {};
+	uint8_t input[input_buffer_size];
+	int input_size = 0;
+	uint8_t output[output_buffer_size];
+	int output_begin = 0;
+	int output_end = 0;
+	uint32_t epoll_events = EPOLLIN;
+};
+
+void handle_stop_signal(int)
+{
+	stopping = true;
+}
+
+// Runs one frame from the client. Returns false if it is malformed.
+bool handle_frame(Session &session, const uint8_t *frame)
+{
+	const auto type = static_cast<Protocol::FrameType>(frame[0]);
+	const uint8_t *payload = frame + Protocol::header_size;
+	const int payload_size = frame[1];
+
+	if (type == Protocol::FrameType::START)
+	{
+		uint64_t seed;
+		PieceRandomizer::Policy policy;
+		if (!Protocol::read_start(payload, payload_size, seed, policy))
+		{
+			return false;
+		}
+		session.game = TetrisGame(seed, policy);
+		session.game_started = true;
+		session.sent_rows = {};
+	}
+	else if (type == Protocol::FrameType::INPUTS && session.game_started)
+	{
+		for (int x = 0; x < payload_size; x++)
+		{
+			if (payload[x] > static_cast<uint8_t>(Replay::Input::ITERATE_TIME))
+			{
+				return false;
+			}
+		}
+		for (int x = 0; x < payload_size && !session.game.get_whether_the_game_is_over(); x++)
+		{
+			session.game.apply_input(static_cast<Replay::Input>(payload[x]));
+		}
+	}
+	else
+	{
+		return false;
+	}
+
+	session.output_end += Protocol::write_state(session.output + session.output_end, session.game, session.sent_rows);
+	return true;
+}
+
+// Runs every whole frame read so far while there is room for its reply.
+// Returns false if the client sent a malformed frame.
+bool handle_frames(Session &session)
+{
+	int position = 0;
+	while (session.input_size - position >= Protocol::header_size &&
+		   session.input_size - position >= Protocol::header_size + session.input[position + 1])
+	{
+		if (session.output_end + Protocol::max_frame_size > Session::output_buffer_size)
+		{
+			if (session.output_begin == 0)
+			{
+				break;
+			}
+			memmove(session.output, session.output + session.output_begin, session.output_end - session.output_begin);
+			session.output_end -= session.output_begin;
+			session.output_begin = 0;
+			continue;
+		}
+		if (!handle_frame(session, session.input + position))
+		{
+			return false;
+		}
+		position += Protocol::header_size + session.input[position + 1];
+	}
+	memmove(session.input, session.input + position, session.input_size - position);
+	session.input_size -= position;
+	return true;
+}
+
+// Returns false if the connection failed.
+bool flush_output(Session &session)
+{
+	while (session.output_begin < session.output_end)
+	{
+		const ssize_t written = send(session.fd, session.output + session.output_begin,
+									 session.output_end - session.output_begin, MSG_NOSIGNAL);
+		if (written < 0)
+		{
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		}
+		session.output_begin += written;
+	}
+	session.output_begin = 0;
+	session.output_end = 0;
+	return true;
+}
+
+// Waits for input only while the session has room to take and answer it,
+// and for the socket to drain only while replies are waiting.
+void update_epoll_events(int epoll_fd, Session &session)
+{
+	const bool can_take_input = session.input_size < Session::input_buffer_size &&
+								session.output_end + Protocol::max_frame_size <= Session::output_buffer_size;
+	const bool has_output = session.output_begin < session.output_end;
+	const uint32_t epoll_events = (can_take_input ? uint32_t(EPOLLIN) : 0) | (has_output ? uint32_t(EPOLLOUT) : 0);
+	if (epoll_events != session.epoll_events)
+	{
+		epoll_event event = {};
+		event.events = epoll_events;
+		event.data.ptr = &session;
+		epoll_ctl(epoll_fd, EPOLL_CTL_MOD, session.fd, &event);
+		session.epoll_events = epoll_events;
+	}
+}
+
+void close_session(int epoll_fd, Session *session)
+{
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, session->fd, nullptr);
+	close(session->fd);
+	delete session;
+	num_sessions--;
+}
+
+void accept_sessions(int epoll_fd, int listen_fd, int max_sessions)
+{
+	while (true)
+	{
+		const int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+		{
+			return;
+		}
+		if (num_sessions.fetch_add(1) >= max_sessions)
+		{
+			num_sessions--;
+			close(fd);
+			continue;
+		}
+
+		const int enable = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+		Session *session = new Session;
+		session->fd = fd;
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.ptr = session;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+		{
+			close(fd);
+			delete session;
+			num_sessions--;
+		}
+	}
+}
+
+void run_event_loop(int listen_fd, int max_sessions)
+{
+	const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	// Every loop waits on the listening socket, and EPOLLEXCLUSIVE wakes only
+	// one of them per new connection.
+	epoll_event listen_event = {};
+	listen_event.events = EPOLLIN | EPOLLEXCLUSIVE;
+	listen_event.data.ptr = nullptr;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &listen_event);
+
+	const int max_events = 256;
+	epoll_event events[max_events];
+	while (!stopping)
+	{
+		const int num_events = epoll_wait(epoll_fd, events, max_events, 200);
+		for (int x = 0; x < num_events; x++)
+		{
+			Session *session = static_cast<Session *>(events[x].data.ptr);
+			if (!session)
+			{
+				accept_sessions(epoll_fd, listen_fd, max_sessions);
+				continue;
+			}
+
+			bool connection_is_open = !(events[x].events & (EPOLLERR | EPOLLHUP));
+			if (connection_is_open && (events[x].events & EPOLLIN))
+			{
+				const ssize_t num_read = recv(session->fd, session->input + session->input_size,
+											  Session::input_buffer_size - session->input_size, 0);
+				if (num_read > 0)
+				{
+					session->input_size += num_read;
+					connection_is_open = handle_frames(*session);
+				}
+				else if (num_read == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+				{
+					connection_is_open = false;
+				}
+			}
+			// Replies are sent right away, so EPOLLOUT is only needed when the
+			// socket's send buffer was full.
+			if (connection_is_open)
+			{
+				connection_is_open = flush_output(*session) && handle_frames(*session) && flush_output(*session);
+			}
+
+			if (connection_is_open)
+			{
+				update_epoll_events(epoll_fd, *session);
+			}
+			else
+			{
+				close_session(epoll_fd, session);
+			}
+		}
+	}
+	close(epoll_fd);
+}
+
+bool open_tcp_socket(int port, int &listen_fd)
+{
+	listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	const int enable = 1;
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	return listen_fd >= 0 &&
+		   bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0 &&
+		   listen(listen_fd, SOMAXCONN) == 0;
+}
+
+bool open_unix_socket(const char *path, int &listen_fd)
+{
+	sockaddr_un address = {};
+	if (strlen(path) >= sizeof(address.sun_path))
+	{
+		return false;
+	}
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	unlink(path);
+	listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	return listen_fd >= 0 &&
+		   bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0 &&
+		   listen(listen_fd, SOMAXCONN) == 0;
+}
+
+void print_usage(const char *program)
+{
+	fprintf(stderr, "Usage: %s [--threads N] [--max-sessions N] --tcp PORT|--unix PATH\n", program);
+	fprintf(stderr, "  --threads N       event loops, 0 for one per hardware thread (default 1)\n");
+	fprintf(stderr, "  --max-sessions N  connections to accept at once (default 10000)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int num_threads = 1;
+	int max_sessions = 10000;
+	int port = -1;
+	const char *unix_path = nullptr;
+
+	for (int arg = 1; arg < argc; arg += 2)
+	{
+		if (arg + 1 >= argc)
+		{
+			print_usage(argv[0]);
+			return 1;
+		}
+		if (strcmp(argv[arg], "--threads") == 0)
+		{
+			num_threads = atoi(argv[arg + 1]);
+		}
+		else if (strcmp(argv[arg], "--max-sessions") == 0)
+		{
+			max_sessions = atoi(argv[arg + 1]);
+		}
+		else if (strcmp(argv[arg], "--tcp") == 0)
+		{
+			port = atoi(argv[arg + 1]);
+		}
+		else if (strcmp(argv[arg], "--unix") == 0)
+		{
+			unix_path = argv[arg + 1];
+		}
+		else
+		{
+			print_usage(argv[0]);
+			return 1;
+		}
+	}
+	if ((port < 0) == !unix_path)
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+	if (num_threads <= 0)
+	{
+		num_threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	const std::string address = unix_path ? std::string("unix socket ") + unix_path : "tcp port " + std::to_string(port);
+	int listen_fd;
+	if (unix_path ? !open_unix_socket(unix_path, listen_fd) : !open_tcp_socket(port, listen_fd))
+	{
+		fprintf(stderr, "Failed to listen on %s: %s\n", address.c_str(), strerror(errno));
+		return 1;
+	}
+
+	signal(SIGINT, handle_stop_signal);
+	signal(SIGTERM, handle_stop_signal);
+	printf("listening on %s with %d event loops\n", address.c_str(), num_threads);
+	fflush(stdout);
+
+	std::vector<std::thread> threads;
+	for (int x = 1; x < num_threads; x++)
+	{
+		threads.emplace_back(run_event_loop, listen_fd, max_sessions);
+	}
+	run_event_loop(listen_fd, max_sessions);
+	for (auto &thread : threads)
+	{
+		thread.join();
+	}
+
+	close(listen_fd);
+	if (unix_path)
+	{
+		unlink(unix_path);
+	}
+	return 0;
+}
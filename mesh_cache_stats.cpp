@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "VertexCacheOptimizer.h"
+
+// Reports how many vertex shader runs a mesh takes before and after
+// VertexCacheOptimizer, on a simulated FIFO post-transform cache. Meshes are
+// indexed the way the game loads them, merging corners with identical
+// position, UV and normal. A shuffled grid gives a mesh large enough for the
+// triangle order to matter.
+
+struct IndexedMesh
+{
+	std::vector<uint32_t> indices;
+	int num_vertices = 0;
+};
+
+bool load_obj(const char *filename, IndexedMesh &mesh)
+{
+	std::ifstream file(filename);
+	if (!file)
+	{
+		return false;
+	}
+
+	std::vector<std::array<float, 3>> positions;
+	std::vector<std::array<float, 2>> uvs;
+	std::vector<std::array<float, 3>> normals;
+	std::map<std::array<float, 8>, uint32_t> vertex_indices;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream words(line);
+		std::string type;
+		words >> type;
+		if (type == "v" || type == "vn")
+		{
+			std::array<float, 3> v;
+			words >> v[0] >> v[1] >> v[2];
+			(type == "v" ? positions : normals).push_back(v);
+		}
+		else if (type == "vt")
+		{
+			std::array<float, 2> uv;
+			words >> uv[0] >> uv[1];
+			uvs.push_back(uv);
+		}
+		else if (type == "f")
+		{
+			// Polygons are split into a fan of triangles.
+			std::vector<uint32_t> corners;
+			std::string corner;
+			while (words >> corner)
+			{
+				unsigned int v, vt, vn;
+				if (sscanf(corner.c_str(), "%u/%u/%u", &v, &vt, &vn) != 3 ||
+					v == 0 || v > positions.size() || vt == 0 || vt > uvs.size() || vn == 0 || vn > normals.size())
+				{
+					return false;
+				}
+				const auto &p = positions[v - 1];
+				const auto &t = uvs[vt - 1];
+				const auto &n = normals[vn - 1];
+				auto inserted = vertex_indices.emplace(std::array<float, 8>{p[0], p[1], p[2], t[0], t[1], n[0], n[1], n[2]}, vertex_indices.size());
+				corners.push_back(inserted.first->second);
+			}
+			for (size_t x = 2; x < corners.size(); x++)
+			{
+				mesh.indices.insert(mesh.indices.end(), {corners[0], corners[x - 1], corners[x]});
+			}
+		}
+	}
+	mesh.num_vertices = vertex_indices.size();
+	return !mesh.indices.empty();
+}
+
+// A size by size grid of quads, two triangles each, in a random order.
+IndexedMesh make_shuffled_grid(const int size)
+{
+	std::vector<std::array<uint32_t, 3>> triangles;
+	for (int i = 0; i < size; i++)
+	{
+		for (int j = 0; j < size; j++)
+		{
+			const uint32_t corner = i * (size + 1) + j;
+			triangles.push_back({corner, corner + 1, corner + size + 1});
+			triangles.push_back({corner + 1, corner + size + 2, corner + size + 1});
+		}
+	}
+	std::mt19937_64 rng(1);
+	std::shuffle(triangles.begin(), triangles.end(), rng);
+
+	IndexedMesh mesh;
+	for (const auto &triangle : triangles)
+	{
+		mesh.indices.insert(mesh.indices.end(), triangle.begin(), triangle.end());
+	}
+	mesh.num_vertices = (size + 1) * (size + 1);
+	return mesh;
+}
+
+void print_stats(const char *name, IndexedMesh mesh, const int cache_entries)
+{
+	const int num_triangles = mesh.indices.size() / 3;
+	const int misses_before = VertexCacheOptimizer::count_cache_misses(mesh.indices, mesh.num_vertices, cache_entries);
+	VertexCacheOptimizer::optimize_triangle_order(mesh.indices, mesh.num_vertices);
+	const int misses_after = VertexCacheOptimizer::count_cache_misses(mesh.indices, mesh.num_vertices, cache_entries);
+	printf("%-40s %7d %9d %10d %10d %10d %6.3f -> %.3f\n",
+		   name,
+		   num_triangles,
+		   mesh.num_vertices,
+		   3 * num_triangles,
+		   misses_before,
+		   misses_after,
+		   double(misses_before) / num_triangles,
+		   double(misses_after) / num_triangles);
+}
+
+void print_usage(const char *program)
+{
+	fprintf(stderr, "Usage: %s [--cache ENTRIES] [--grid SIZE] [OBJ_FILE...]\n", program);
+	fprintf(stderr, "  --cache ENTRIES  simulated FIFO cache size (default 32)\n");
+	fprintf(stderr, "  --grid SIZE      also test a SIZE by SIZE grid of quads in a shuffled order\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int cache_entries = 32;
+	int grid_size = 0;
+	int arg = 1;
+	while (arg + 1 < argc && strncmp(argv[arg], "--", 2) == 0)
+	{
+		if (strcmp(argv[arg], "--cache") == 0)
+		{
+			cache_entries = atoi(argv[arg + 1]);
+		}
+		else if (strcmp(argv[arg], "--grid") == 0)
+		{
+			grid_size = atoi(argv[arg + 1]);
+		}
+		else
+		{
+			print_usage(argv[0]);
+			return 1;
+		}
+		arg += 2;
+	}
+	if ((arg == argc && grid_size <= 0) || cache_entries < 3 || grid_size < 0)
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	printf("%-40s %7s %9s %10s %10s %10s %s\n", "mesh", "tris", "vertices", "unindexed", "cached", "optimized", "misses/triangle");
+	for (; arg < argc; arg++)
+	{
+		IndexedMesh mesh;
+		if (!load_obj(argv[arg], mesh))
+		{
+			fprintf(stderr, "Failed to load mesh %s\n", argv[arg]);
+			return 1;
+		}
+		print_stats(argv[arg], mesh, cache_entries);
+	}
+	if (grid_size > 0)
+	{
+		const std::string name = "shuffled " + std::to_string(grid_size) + "x" + std::to_string(grid_size) + " grid";
+		print_stats(name.c_str(), make_shuffled_grid(grid_size), cache_entries);
+	}
+	return 0;
+}
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TetrisGame.h"
+#include "PlacementGenerator.h"
+
+// Counts the sequences of placements reachable from a board for a fixed
+// sequence of pieces, like chess perft. The counts at each depth only depend
+// on the movement, rotation, kick and line clear rules, so they double as a
+// regression check for those rules.
+
+using OccupancyBoard = TetrisGame::OccupancyBoard;
+using PT = TetrisGame::PieceType;
+
+struct PerftSearch
+{
+	const std::vector<PT> &pieces;
+	const int max_depth;
+	std::vector<PlacementGenerator> generators;
+	std::vector<uint64_t> nodes_at_depth;
+
+	PerftSearch(const std::vector<PT> &pieces, int max_depth)
+		: pieces(pieces), max_depth(max_depth), generators(max_depth), nodes_at_depth(max_depth + 1, 0)
+	{
+	}
+
+	void count(const OccupancyBoard &board, int depth)
+	{
+		auto &generator = generators[depth];
+		int num_placements = generator.generate(board, TetrisGame::get_spawned_piece(pieces[depth]));
+		nodes_at_depth[depth + 1] += num_placements;
+		if (depth + 1 == max_depth)
+		{
+			return;
+		}
+
+		for (int x = 0; x < num_placements; x++)
+		{
+			OccupancyBoard next_board = board;
+			TetrisGame::lock_piece(next_board, generator.get_placement(x).positions);
+			count(next_board, depth + 1);
+		}
+	}
+};
+
+bool parse_pieces(const char *text, std::vector<PT> &pieces)
+{
+	const std::string piece_letters = "IJLOSZT";
+	for (const char *c = text; *c; c++)
+	{
+		auto index = piece_letters.find(*c);
+		if (index == std::string::npos)
+		{
+			return false;
+		}
+		pieces.push_back(static_cast<PT>(index));
+	}
+	return true;
+}
+
+bool load_board(const char *filename, OccupancyBoard &board)
+{
+	std::string picture;
+	if (strcmp(filename, "empty") != 0)
+	{
+		std::ifstream file(filename);
+		if (!file)
+		{
+			return false;
+		}
+		std::stringstream contents;
+		contents << file.rdbuf();
+		picture = contents.str();
+	}
+
+	TetrisGame game(0);
+	if (!game.set_board(picture))
+	{
+		return false;
+	}
+	board = game.get_locked_rows();
+	return true;
+}
+
+void print_usage(const char *program)
+{
+	fprintf(stderr, "Usage: %s [--threads N] BOARD_FILE|empty PIECES DEPTH\n", program);
+	fprintf(stderr, "  BOARD_FILE  board picture as accepted by TetrisGame::set_board\n");
+	fprintf(stderr, "  PIECES      piece letters to place in order, e.g. TIOSZJL\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int num_threads = 1;
+	int arg = 1;
+	if (arg + 1 < argc && strcmp(argv[arg], "--threads") == 0)
+	{
+		num_threads = atoi(argv[arg + 1]);
+		if (num_threads <= 0)
+		{
+			num_threads = std::thread::hardware_concurrency();
+		}
+		arg += 2;
+	}
+
+	if (argc - arg != 3)
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	OccupancyBoard board;
+	if (!load_board(argv[arg], board))
+	{
+		fprintf(stderr, "Failed to load board %s\n", argv[arg]);
+		return 1;
+	}
+
+	std::vector<PT> pieces;
+	int max_depth = atoi(argv[arg + 2]);
+	if (!parse_pieces(argv[arg + 1], pieces) || max_depth < 1 || max_depth > int(pieces.size()))
+	{
+		fprintf(stderr, "PIECES must have at least DEPTH piece letters and DEPTH must be positive\n");
+		return 1;
+	}
+
+	auto start_time = std::chrono::steady_clock::now();
+
+	// Work is split across threads by root placement.
+	PlacementGenerator root_generator;
+	int num_root_placements = root_generator.generate(board, TetrisGame::get_spawned_piece(pieces[0]));
+	std::atomic<int> next_root_placement(0);
+
+	std::vector<PerftSearch> searches;
+	for (int x = 0; x < num_threads; x++)
+	{
+		searches.emplace_back(pieces, max_depth);
+	}
+
+	std::vector<std::thread> threads;
+	for (auto &search : searches)
+	{
+		threads.emplace_back([&]()
+							 {
+			for (int x = next_root_placement++; x < num_root_placements; x = next_root_placement++)
+			{
+				if (max_depth > 1)
+				{
+					OccupancyBoard next_board = board;
+					TetrisGame::lock_piece(next_board, root_generator.get_placement(x).positions);
+					search.count(next_board, 1);
+				}
+			} });
+	}
+	for (auto &thread : threads)
+	{
+		thread.join();
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+
+	uint64_t total_nodes = num_root_placements;
+	printf("depth 1: %d\n", num_root_placements);
+	for (int depth = 2; depth <= max_depth; depth++)
+	{
+		uint64_t nodes = 0;
+		for (auto &search : searches)
+		{
+			nodes += search.nodes_at_depth[depth];
+		}
+		total_nodes += nodes;
+		printf("depth %d: %llu\n", depth, (unsigned long long)nodes);
+	}
+	printf("%llu nodes in %.3f s (%.0f nodes/s, %d threads)\n",
+		   (unsigned long long)total_nodes, elapsed.count(), total_nodes / elapsed.count(), num_threads);
+
+	return 0;
+}
@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <chrono>
+
+#include "TetrisGame.h"
+
+// Re-simulates a recorded replay with no rendering or waiting and prints the
+// final score, so recorded sessions can be re-verified in bulk.
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s REPLAY_FILE...\n", argv[0]);
+		return 1;
+	}
+
+	int exit_code = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		Replay replay;
+		if (!replay.load(argv[i]))
+		{
+			fprintf(stderr, "Failed to load replay %s\n", argv[i]);
+			exit_code = 1;
+			continue;
+		}
+
+		auto start_time = std::chrono::steady_clock::now();
+		TetrisGame tetris_game(replay.get_seed(), replay.get_policy());
+		replay.play(tetris_game);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+
+		printf("%s: seed %llu, %llu inputs, score %d (%.0f inputs/s)\n",
+			   argv[i],
+			   (unsigned long long)replay.get_seed(),
+			   (unsigned long long)replay.get_num_inputs(),
+			   tetris_game.get_score(),
+			   replay.get_num_inputs() / elapsed.count());
+	}
+
+	return exit_code;
+}
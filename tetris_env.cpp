@@ -0,0 +1,153 @@
+#include <vector>
+
+#include "tetris_env.h"
+#include "TetrisGame.h"
+
+static_assert(TETRIS_ENV_BOARD_HEIGHT == TetrisGame::board_height &&
+                  TETRIS_ENV_BOARD_WIDTH == TetrisGame::board_width &&
+                  TETRIS_ENV_NUM_UPCOMING_PIECES == TetrisGame::num_upcoming_pieces_shown,
+              "the C interface's board dimensions must match TetrisGame");
+static_assert(TETRIS_ENV_NO_PIECE == TetrisGame::num_piece_types, "TETRIS_ENV_NO_PIECE must not be a piece");
+static_assert(TETRIS_ENV_ITERATE_TIME == static_cast<int>(Replay::Input::ITERATE_TIME) &&
+                  TETRIS_ENV_HARD_DROP == static_cast<int>(Replay::Input::HARD_DROP),
+              "actions must have the same values as Replay::Input");
+
+struct TetrisEnv
+{
+    std::vector<TetrisGame> games;
+    std::vector<uint64_t> seeds;
+};
+
+static void write_observation(TetrisGame &game, const int index, const TetrisEnvBuffers *buffers)
+{
+    if (!buffers)
+    {
+        return;
+    }
+
+    if (buffers->board_rows)
+    {
+        const auto locked_rows = game.get_locked_rows();
+        uint16_t *rows = buffers->board_rows + index * TetrisGame::board_height;
+        for (int i = 0; i < TetrisGame::board_height; i++)
+        {
+            rows[i] = locked_rows[i];
+        }
+    }
+
+    const auto falling_piece = game.get_falling_piece();
+    if (buffers->piece_rows)
+    {
+        uint16_t *rows = buffers->piece_rows + index * TetrisGame::board_height;
+        for (int i = 0; i < TetrisGame::board_height; i++)
+        {
+            rows[i] = 0;
+        }
+        for (auto [i, j] : falling_piece.positions)
+        {
+            rows[i] |= uint16_t(1) << j;
+        }
+    }
+
+    if (buffers->falling_pieces)
+    {
+        buffers->falling_pieces[index] = static_cast<uint8_t>(falling_piece.type);
+    }
+
+    if (buffers->upcoming_pieces)
+    {
+        uint8_t *upcoming = buffers->upcoming_pieces + index * TetrisGame::num_upcoming_pieces_shown;
+        for (int x = 0; x < TetrisGame::num_upcoming_pieces_shown; x++)
+        {
+            upcoming[x] = static_cast<uint8_t>(game.get_upcoming_piece(x));
+        }
+    }
+
+    if (buffers->held_pieces)
+    {
+        buffers->held_pieces[index] = game.get_whether_a_piece_is_held() ? static_cast<uint8_t>(game.get_held_piece()) : static_cast<uint8_t>(TETRIS_ENV_NO_PIECE);
+    }
+}
+
+TetrisEnv *tetris_env_create(const int32_t num_games, const uint64_t *seeds)
+{
+    if (num_games <= 0 || !seeds)
+    {
+        return nullptr;
+    }
+
+    TetrisEnv *env = new TetrisEnv;
+    env->seeds.assign(seeds, seeds + num_games);
+    env->games.reserve(num_games);
+    for (int x = 0; x < num_games; x++)
+    {
+        env->games.emplace_back(seeds[x]);
+    }
+    return env;
+}
+
+void tetris_env_destroy(TetrisEnv *env)
+{
+    delete env;
+}
+
+int32_t tetris_env_get_num_games(const TetrisEnv *env)
+{
+    return env->games.size();
+}
+
+void tetris_env_reset(TetrisEnv *env, const uint64_t *seeds, const TetrisEnvBuffers *buffers)
+{
+    const int num_games = env->games.size();
+    for (int x = 0; x < num_games; x++)
+    {
+        env->seeds[x] = seeds ? seeds[x] : env->seeds[x] + num_games;
+        env->games[x] = TetrisGame(env->seeds[x]);
+        write_observation(env->games[x], x, buffers);
+        if (buffers && buffers->score_deltas)
+        {
+            buffers->score_deltas[x] = 0;
+        }
+        if (buffers && buffers->dones)
+        {
+            buffers->dones[x] = 0;
+        }
+    }
+}
+
+int32_t tetris_env_step(TetrisEnv *env, const uint8_t *actions, const TetrisEnvBuffers *buffers)
+{
+    const int num_games = env->games.size();
+    for (int x = 0; x < num_games; x++)
+    {
+        if (actions[x] >= TETRIS_ENV_NUM_ACTIONS)
+        {
+            return -1;
+        }
+    }
+
+    for (int x = 0; x < num_games; x++)
+    {
+        TetrisGame &game = env->games[x];
+        const int previous_score = game.get_score();
+        game.apply_input(static_cast<Replay::Input>(actions[x]));
+        const int score_delta = game.get_score() - previous_score;
+        const bool done = game.get_whether_the_game_is_over();
+        if (done)
+        {
+            env->seeds[x] += num_games;
+            game = TetrisGame(env->seeds[x]);
+        }
+
+        write_observation(game, x, buffers);
+        if (buffers && buffers->score_deltas)
+        {
+            buffers->score_deltas[x] = score_delta;
+        }
+        if (buffers && buffers->dones)
+        {
+            buffers->dones[x] = done;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+
+// A C interface to a batch of headless games for training pipelines, built as
+// the tetris_env shared library. Observations are written straight into
+// contiguous arrays owned by the caller, laid out game after game, so a
+// Python trainer can hand over numpy buffers once and read every step's
+// results from them without any further calls or copies.
+
+// TETRIS_ENV_BUILDING is only defined while the library itself is compiled,
+// so on Windows the library exports the functions and its users import them.
+#if defined(_WIN32) && defined(TETRIS_ENV_BUILDING)
+#define TETRIS_ENV_API __declspec(dllexport)
+#elif defined(_WIN32)
+#define TETRIS_ENV_API __declspec(dllimport)
+#else
+#define TETRIS_ENV_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    enum
+    {
+        TETRIS_ENV_BOARD_HEIGHT = 22,
+        TETRIS_ENV_BOARD_WIDTH = 10,
+        TETRIS_ENV_NUM_UPCOMING_PIECES = 5,
+        // Written as the held piece when nothing is held.
+        TETRIS_ENV_NO_PIECE = 7
+    };
+
+    // Actions are the inputs a player can give, with the same values as
+    // Replay::Input. ITERATE_TIME is a gravity tick with no input.
+    enum
+    {
+        TETRIS_ENV_LEFT,
+        TETRIS_ENV_RIGHT,
+        TETRIS_ENV_ROTATE_LEFT,
+        TETRIS_ENV_ROTATE_RIGHT,
+        TETRIS_ENV_SOFT_DROP,
+        TETRIS_ENV_HARD_DROP,
+        TETRIS_ENV_HOLD,
+        TETRIS_ENV_ITERATE_TIME,
+        TETRIS_ENV_NUM_ACTIONS
+    };
+
+    // Caller-owned output arrays. Any of them may be null to skip it. Rows are
+    // bit masks with bit j set when column j is occupied, bottom row first.
+    // Pieces are TetrisGame::PieceType values (I, J, L, O, S, Z, T).
+    typedef struct
+    {
+        uint16_t *board_rows;      // num_games * TETRIS_ENV_BOARD_HEIGHT, locked squares
+        uint16_t *piece_rows;      // num_games * TETRIS_ENV_BOARD_HEIGHT, falling piece squares
+        uint8_t *falling_pieces;   // num_games
+        uint8_t *upcoming_pieces;  // num_games * TETRIS_ENV_NUM_UPCOMING_PIECES, next piece first
+        uint8_t *held_pieces;      // num_games
+        int32_t *score_deltas;     // num_games, lines cleared by the step
+        uint8_t *dones;            // num_games, 1 if the step ended the game
+    } TetrisEnvBuffers;
+
+    typedef struct TetrisEnv TetrisEnv;
+
+    // Creates num_games games with the given seeds. Returns null if num_games
+    // is not positive or seeds is null.
+    TETRIS_ENV_API TetrisEnv *tetris_env_create(int32_t num_games, const uint64_t *seeds);
+    TETRIS_ENV_API void tetris_env_destroy(TetrisEnv *env);
+    TETRIS_ENV_API int32_t tetris_env_get_num_games(const TetrisEnv *env);
+
+    // Restarts every game, with the given seeds or, if seeds is null, with
+    // each game's seed advanced by num_games, and writes the first
+    // observations.
+    TETRIS_ENV_API void tetris_env_reset(TetrisEnv *env, const uint64_t *seeds, const TetrisEnvBuffers *buffers);
+
+    // Applies actions[i] to game i and writes the resulting observations. A
+    // game that ends is reported as done and restarted with its seed advanced
+    // by num_games, so its observation is already the start of the next
+    // game. Returns 0, or -1 without stepping anything if an action is out of
+    // range.
+    TETRIS_ENV_API int32_t tetris_env_step(TetrisEnv *env, const uint8_t *actions, const TetrisEnvBuffers *buffers);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "TetrisGame.h"
+#include "GreedyBot.h"
+#include "VersusRunner.h"
+
+// Plays versus matches between greedy bots across every core and prints how
+// fast they ran and how much garbage was exchanged.
+
+bool parse_policy(const char *text, PieceRandomizer::Policy &policy)
+{
+	const char *names[] = {"7bag", "14bag", "tgm", "uniform"};
+	for (int x = 0; x < 4; x++)
+	{
+		if (strcmp(text, names[x]) == 0)
+		{
+			policy = static_cast<PieceRandomizer::Policy>(x);
+			return true;
+		}
+	}
+	return false;
+}
+
+void print_usage(const char *program)
+{
+	fprintf(stderr, "Usage: %s [--threads N] [--players P] [--ticks MAX] [--policy 7bag|14bag|tgm|uniform] [--seed FIRST_SEED] MATCHES\n", program);
+	fprintf(stderr, "  --threads N  worker threads, 0 for every hardware thread (default 0)\n");
+	fprintf(stderr, "  --players P  boards per match, 2 to %d (default 2)\n", VersusRunner::max_players);
+	fprintf(stderr, "  --ticks MAX  pieces per board before a match is called a draw (default 10000)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int num_threads = 0;
+	int num_players = 2;
+	int max_ticks = 10000;
+	uint64_t first_seed = 1;
+	auto policy = PieceRandomizer::Policy::SEVEN_BAG;
+
+	int arg = 1;
+	while (arg + 1 < argc && strncmp(argv[arg], "--", 2) == 0)
+	{
+		if (strcmp(argv[arg], "--threads") == 0)
+		{
+			num_threads = atoi(argv[arg + 1]);
+		}
+		else if (strcmp(argv[arg], "--players") == 0)
+		{
+			num_players = atoi(argv[arg + 1]);
+		}
+		else if (strcmp(argv[arg], "--ticks") == 0)
+		{
+			max_ticks = atoi(argv[arg + 1]);
+		}
+		else if (strcmp(argv[arg], "--seed") == 0)
+		{
+			first_seed = strtoull(argv[arg + 1], nullptr, 10);
+		}
+		else if (strcmp(argv[arg], "--policy") != 0 || !parse_policy(argv[arg + 1], policy))
+		{
+			print_usage(argv[0]);
+			return 1;
+		}
+		arg += 2;
+	}
+
+	if (argc - arg != 1 || num_players < 2 || num_players > VersusRunner::max_players || max_ticks < 1)
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	VersusRunner runner(num_threads);
+	GreedyBot bot(runner.get_num_threads());
+	const auto results = runner.run_matches(first_seed, atoi(argv[arg]), num_players, policy, [&](TetrisGame &game, int worker)
+											{ return bot.play_move(game, worker); },
+											max_ticks);
+
+	printf("%llu matches of %d, %llu pieces in %.3f s (%.1f matches/s, %.0f pieces/s)\n",
+		   (unsigned long long)results.num_matches, num_players, (unsigned long long)results.num_pieces, results.seconds,
+		   results.num_matches / results.seconds, results.num_pieces / results.seconds);
+	if (results.num_matches == 0)
+	{
+		return 0;
+	}
+
+	printf("mean match length %.1f ticks, %llu draws\n",
+		   double(results.num_ticks) / results.num_matches, (unsigned long long)results.num_draws);
+	printf("garbage per piece: %.3f sent, %.3f cancelled, %.3f received\n",
+		   double(results.lines_sent) / results.num_pieces, double(results.lines_cancelled) / results.num_pieces,
+		   double(results.lines_received) / results.num_pieces);
+	const auto [fewest_wins, most_wins] = std::minmax_element(results.wins_by_seat.begin(), results.wins_by_seat.end());
+	printf("wins per seat: %llu to %llu\n", (unsigned long long)*fewest_wins, (unsigned long long)*most_wins);
+	return 0;
+}